@@ -0,0 +1,54 @@
+{
+  lib,
+  stdenv,
+  llvm,
+  imgui,
+  jetbrains-mono,
+  # Baked, and rasterized at runtime to compare, see timeStartup
+  font ? "${jetbrains-mono}/share/fonts/truetype/JetBrainsMono-Regular.ttf",
+  ...
+}:
+stdenv.mkDerivation {
+  pname = "clack-ui-bench";
+  version = "0.1.0";
+  src = lib.fileset.toSource {
+    root = ./.;
+    fileset = lib.fileset.unions [
+      ./src
+      ./bench
+      ./tools
+    ];
+  };
+
+  buildInputs = [
+    llvm.libcxx
+    imgui
+  ];
+
+  # No sanitizers here: they replace the allocator and distort timings.
+  FLAGS = [
+    "--start-no-unused-arguments"
+    "-std=c++23"
+    "-O2"
+    "-stdlib=libc++"
+    "-fstrict-enums"
+    "-fno-operator-names"
+    "-fno-common"
+    "-fno-math-errno"
+    "-Wall"
+    "-Wconversion"
+  ];
+
+  buildPhase = ''
+    $CXX tools/bake_font.cc -limgui -o bake_font $FLAGS
+    ./bake_font ${font} src/font_atlas.inc
+
+    $CXX bench/ui.cc -limgui -o clack-ui-bench -DBENCH_FONT='"${font}"' $FLAGS
+  '';
+
+  installPhase = ''
+    install -D -t $out/bin clack-ui-bench
+  '';
+
+  meta.mainProgram = "clack-ui-bench";
+}
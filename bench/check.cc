@@ -0,0 +1,763 @@
+// Checks too slow or too broad to run in the app, run by `nix flake check`:
+//
+//   vmath         the batch kernels' errors, measured against long double,
+//                 within the bounds vmath.hh documents
+//   differential  Incremental against Evaluator on random expressions and
+//                 variable edits, and integral expressions against their
+//                 exact or fallen back results
+//   cases         expressions with known results
+//   precision     evaluateAs in float and long double
+//   threads       sums on one thread against sums on several
+//   editor        the gap buffer against a string under random edits
+//   store         VariableStore snapshots under concurrent edits; meant to
+//                 run under ThreadSanitizer too
+//
+// Pass check names to run only those. Exits nonzero if any check fails.
+
+#include <atomic>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <map>
+#include <numbers>
+#include <optional>
+#include <random>
+#include <span>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../src/editor.cc"
+#include "../src/evaluator.cc"
+#include "../src/functions.cc"
+#include "../src/incremental.cc"
+#include "../src/parser.cc"
+#include "../src/stack.cc"
+#include "../src/variables.cc"
+#include "../src/vmath.cc"
+#include "../src/worker.cc"
+
+using Kernel = void (*)(std::span<const double>, std::span<double>);
+
+// |got - reference| in units of the spacing of doubles at the reference
+static double ulpError(double got, long double reference) {
+  double rounded = static_cast<double>(reference);
+  if (std::isnan(got) || std::isnan(rounded)) {
+    return std::isnan(got) == std::isnan(rounded) ? 0 : INFINITY;
+  }
+  if (std::isinf(rounded) || std::isinf(got)) {
+    return got == rounded ? 0 : INFINITY;
+  }
+  double magnitude = std::fabs(rounded);
+  double ulp = std::nextafter(magnitude, INFINITY) - magnitude;
+  return static_cast<double>(std::fabs(got - reference) /
+                             static_cast<long double>(ulp));
+}
+
+struct Range {
+  const char* name;
+  Kernel kernel;
+  long double (*reference)(long double);
+  double low, high;
+  bool logarithmic;  // Inputs spread evenly over exponents, not values
+  double bound;      // Documented maximum error, in ULPs
+};
+
+static bool vmathCheck() {
+  // Where long double is double, the reference is itself off by up to half
+  // an ULP, and so may be the measured error.
+  double slack = std::numeric_limits<long double>::digits > 53 ? 0 : 0.5;
+  // sin and cos reduce their argument exactly up to 2^20 * pi/2.
+  constexpr double kReduced = (1 << 20) * std::numbers::pi / 2;
+  const Range ranges[] = {
+      {"exp", vmath::exp, expl, -745, 709.7, false, 1},
+      {"exp", vmath::exp, expl, -1, 1, false, 1},
+      {"log", vmath::log, logl, -690, 690, true, 1},
+      {"log", vmath::log, logl, 0.5, 2, false, 1},
+      {"sin", vmath::sin, sinl, -10, 10, false, 1},
+      {"sin", vmath::sin, sinl, -kReduced, kReduced, false, 1},
+      {"sin", vmath::sin, sinl, -1e10, 1e10, false, 1},
+      {"cos", vmath::cos, cosl, -10, 10, false, 1},
+      {"cos", vmath::cos, cosl, -kReduced, kReduced, false, 1},
+      {"cos", vmath::cos, cosl, -1e10, 1e10, false, 1},
+      {"sqrt", vmath::sqrt, sqrtl, -690, 690, true, 0.5},
+  };
+
+  bool ok = true;
+  std::mt19937_64 random(1);
+  std::vector<double> in(1 << 20), out(in.size());
+  for (const Range& range : ranges) {
+    std::uniform_real_distribution<double> uniform(range.low, range.high);
+    for (double& x : in) {
+      x = range.logarithmic ? std::exp(uniform(random)) : uniform(random);
+    }
+    range.kernel(in, out);
+
+    double worst = 0, worst_at = 0;
+    for (size_t i = 0; i < in.size(); ++i) {
+      double error = ulpError(out[i], range.reference(in[i]));
+      if (error > worst) {
+        worst = error;
+        worst_at = in[i];
+      }
+    }
+    bool passed = worst <= range.bound + slack;
+    ok &= passed;
+    std::printf("vmath: %-4s %s[%g, %g]: max %.3f ULP at %.17g%s\n",
+                range.name, range.logarithmic ? "e^" : "", range.low,
+                range.high, worst, worst_at, passed ? "" : "  FAILED");
+  }
+
+  // Special inputs give what the scalar functions do.
+  const double special[] = {0.0,     -0.0,    INFINITY, -INFINITY,
+                            NAN,     -1.0,    5e-324,   1e-310,
+                            709.78,  709.79,  -745.13,  -745.14};
+  const struct {
+    const char* name;
+    Kernel kernel;
+    double (*scalar)(double);
+  } kernels[] = {{"exp", vmath::exp, std::exp}, {"log", vmath::log, std::log},
+                 {"sin", vmath::sin, std::sin}, {"cos", vmath::cos, std::cos},
+                 {"sqrt", vmath::sqrt, std::sqrt}};
+  double results[std::size(special)];
+  for (const auto& kernel : kernels) {
+    kernel.kernel(std::span(special), std::span(results));
+    for (size_t i = 0; i < std::size(special); ++i) {
+      double expected = kernel.scalar(special[i]);
+      if (ulpError(results[i], expected) <= 1) continue;
+      ok = false;
+      std::printf("vmath: %s(%g) = %g, expected %g  FAILED\n", kernel.name,
+                  special[i], results[i], expected);
+    }
+  }
+
+  return ok;
+}
+
+// Random expressions, fully parenthesized so the text fixes the tree. Every
+// integral subtree also carries its value by the rules the evaluator
+// promises: an int64 for each step that is exact, whatever the branches and
+// operands that aren't evaluated would do, and a double computed from its
+// operands for each step that isn't.
+struct Generated {
+  std::string text;
+  bool integral = false;
+  Evaluator::Result value;  // Only for integral subtrees
+};
+
+class Generator {
+ public:
+  explicit Generator(std::uint32_t seed) : random(seed) {}
+
+  Generated expression(int depth) { return any(depth, 0); }
+  Generated integral(int depth) { return exact(depth); }
+
+ private:
+  std::mt19937 random;
+
+  size_t pick(size_t n) { return random() % n; }
+
+  static std::optional<std::int64_t> narrow(__int128 value) {
+    if (value < std::numeric_limits<std::int64_t>::min() ||
+        value > std::numeric_limits<std::int64_t>::max()) {
+      return std::nullopt;
+    }
+    return static_cast<std::int64_t>(value);
+  }
+
+  static std::optional<std::int64_t> power(std::int64_t base,
+                                           std::int64_t exponent) {
+    if (exponent < 0) return std::nullopt;
+    if (base == 0) return exponent == 0 ? 1 : 0;
+    if (base == 1) return 1;
+    if (base == -1) return exponent % 2 == 0 ? 1 : -1;
+    __int128 result = 1;
+    for (std::int64_t i = 0; i < exponent; ++i) {
+      result *= base;
+      if (!narrow(result)) return std::nullopt;
+    }
+    return narrow(result);
+  }
+
+  static std::optional<std::int64_t> exactly(const std::string& op,
+                                             std::int64_t left,
+                                             std::int64_t right) {
+    __int128 l = left, r = right;
+    if (op == "+") return narrow(l + r);
+    if (op == "-") return narrow(l - r);
+    if (op == "*") return narrow(l * r);
+    if (op == "/") {
+      if (r == 0 || l % r != 0) return std::nullopt;
+      return narrow(l / r);
+    }
+    if (op == "%") {
+      if (r == 0) return std::nullopt;
+      return narrow(l % r);
+    }
+    if (op == "^") return power(left, right);
+    if (op == "<") return left < right;
+    if (op == "<=") return left <= right;
+    if (op == ">") return left > right;
+    if (op == ">=") return left >= right;
+    if (op == "==") return left == right;
+    return left != right;
+  }
+
+  static Evaluator::Result inDouble(const std::string& op, double left,
+                                    double right) {
+    if ((op == "/" || op == "%") && right == 0) {
+      return std::unexpected(Expr::Error::DivisionByZero);
+    }
+    if (op == "+") return left + right;
+    if (op == "-") return left - right;
+    if (op == "*") return left * right;
+    if (op == "/") return left / right;
+    if (op == "%") return std::fmod(left, right);
+    if (op == "^") return std::pow(left, right);
+    if (op == "<") return double(left < right);
+    if (op == "<=") return double(left <= right);
+    if (op == ">") return double(left > right);
+    if (op == ">=") return double(left >= right);
+    if (op == "==") return double(left == right);
+    return double(left != right);
+  }
+
+  static Evaluator::Result arithmetic(const std::string& op,
+                                      const Evaluator::Result& left,
+                                      const Evaluator::Result& right) {
+    if (!left) return left;
+    if (!right) return right;
+    auto l = std::get_if<std::int64_t>(&*left);
+    auto r = std::get_if<std::int64_t>(&*right);
+    if (l && r) {
+      if (auto value = exactly(op, *l, *r)) return *value;
+    }
+    return inDouble(op, toDouble(*left), toDouble(*right));
+  }
+
+  static bool isTrue(const Evaluator::Result& value) {
+    return toDouble(*value) != 0;
+  }
+
+  // An int64 only if every operand used is one
+  static Evaluator::Result select(const Evaluator::Result& used,
+                                  const Evaluator::Result& result) {
+    if (std::holds_alternative<std::int64_t>(*used)) return result;
+    return toDouble(*result);
+  }
+
+  Generated literal() {
+    static constexpr const char* kLiterals[] = {
+        "0", "1", "2", "3", "7", "10", "62", "63", "64",
+        "4611686018427387904", "9223372036854775807", "3037000499",
+        "3037000500"};
+    std::string text = kLiterals[pick(std::size(kLiterals))];
+    return {text, true, static_cast<std::int64_t>(std::stoll(text))};
+  }
+
+  // Integer literals and operators on them only
+  Generated exact(int depth) {
+    if (depth == 0 || pick(4) == 0) return literal();
+
+    static constexpr const char* kOperators[] = {
+        "+", "-", "*", "/", "%", "^", "<", "<=", ">", ">=", "==", "!="};
+    switch (pick(5)) {
+      case 0: {
+        Generated operand = exact(depth - 1);
+        Evaluator::Result value = operand.value;
+        if (value && std::holds_alternative<double>(*value)) {
+          value = -std::get<double>(*value);
+        } else if (value) {
+          value = arithmetic("-", std::int64_t{0}, value);
+        }
+        return {"(-" + operand.text + ")", true, value};
+      }
+      case 1: {
+        bool is_and = pick(2) == 0;
+        Generated left = exact(depth - 1), right = exact(depth - 1);
+        Evaluator::Result value = left.value;
+        if (value) {
+          bool decided = isTrue(left.value) != is_and;
+          if (decided) {
+            value = select(left.value, std::int64_t{isTrue(left.value)});
+          } else if (!right.value) {
+            value = right.value;
+          } else {
+            value = select(left.value,
+                           select(right.value,
+                                  std::int64_t{isTrue(right.value)}));
+          }
+        }
+        return {"(" + left.text + (is_and ? " && " : " || ") + right.text +
+                    ")",
+                true, value};
+      }
+      case 2: {
+        Generated condition = exact(depth - 1), then = exact(depth - 1),
+                  otherwise = exact(depth - 1);
+        Evaluator::Result value = condition.value;
+        if (value) {
+          const Evaluator::Result& taken =
+              isTrue(condition.value) ? then.value : otherwise.value;
+          value = taken ? select(condition.value, taken) : taken;
+        }
+        return {"(" + condition.text + " ? " + then.text + " : " +
+                    otherwise.text + ")",
+                true, value};
+      }
+      default: {
+        std::string op = kOperators[pick(std::size(kOperators))];
+        Generated left = exact(depth - 1), right = exact(depth - 1);
+        return {"(" + left.text + " " + op + " " + right.text + ")", true,
+                arithmetic(op, left.value, right.value)};
+      }
+    }
+  }
+
+  Generated any(int depth, int sums) {
+    if (depth == 0 || pick(5) == 0) {
+      switch (pick(4)) {
+        case 0:
+          return literal();
+        case 1:
+          return {pick(2) ? "0.5" : "2.25"};
+        default: {
+          // Indices of the enclosing sums are i, j, ...
+          static constexpr const char* kNames[] = {"x", "y", "z", "i", "j"};
+          return {kNames[pick(3 + static_cast<size_t>(sums))]};
+        }
+      }
+    }
+
+    static constexpr const char* kOperators[] = {
+        "+", "-", "*", "/", "%", "^", "<", "<=", ">", ">=", "==", "!=",
+        "&&", "||"};
+    static constexpr const char* kUnary[] = {"abs", "sqrt", "floor", "sin",
+                                             "exp", "ln"};
+    switch (pick(8)) {
+      case 0:
+        return exact(depth);
+      case 1:
+        return {"(-" + any(depth - 1, sums).text + ")"};
+      case 2:
+        return {"(" + any(depth - 1, sums).text + " ? " +
+                any(depth - 1, sums).text + " : " +
+                any(depth - 1, sums).text + ")"};
+      case 3:
+        return {std::string(kUnary[pick(std::size(kUnary))]) + "(" +
+                any(depth - 1, sums).text + ")"};
+      case 4: {
+        std::string name = pick(2) ? "max(" : "min(";
+        return {name + any(depth - 1, sums).text + ", " +
+                any(depth - 1, sums).text + ", " +
+                any(depth - 1, sums).text + ")"};
+      }
+      case 5:
+        if (sums < 2) {
+          std::string index = sums == 0 ? "i" : "j";
+          std::string from = std::to_string(pick(3));
+          std::string to = pick(2) ? "x" : std::to_string(pick(6));
+          return {(pick(2) ? "sum(" : "prod(") + index + ", " + from + ", " +
+                  to + ", " + any(depth - 1, sums + 1).text + ")"};
+        }
+        [[fallthrough]];
+      default:
+        return {"(" + any(depth - 1, sums).text + " " +
+                kOperators[pick(std::size(kOperators))] + " " +
+                any(depth - 1, sums).text + ")"};
+    }
+  }
+};
+
+// Same alternative and the same bits, so int64 against double, 0 against
+// -0 and differing NaNs all count as mismatches.
+static bool same(const Evaluator::Result& a, const Evaluator::Result& b) {
+  if (!a || !b) return !a && !b && a.error() == b.error();
+  if (a->index() != b->index()) return false;
+  if (auto i = std::get_if<std::int64_t>(&*a)) {
+    return *i == std::get<std::int64_t>(*b);
+  }
+  return std::bit_cast<std::uint64_t>(std::get<double>(*a)) ==
+         std::bit_cast<std::uint64_t>(std::get<double>(*b));
+}
+
+static std::string show(const Evaluator::Result& result) {
+  if (!result) return std::string(errorToString(result.error()));
+  if (auto i = std::get_if<std::int64_t>(&*result)) {
+    return std::to_string(*i);
+  }
+  char text[32];
+  std::snprintf(text, sizeof(text), "%.17g", std::get<double>(*result));
+  return text;
+}
+
+static constexpr const char* kVariables[] = {"x", "y", "z"};
+static constexpr double kValues[] = {-2, -1, -0.0, 0, 0.5, 1, 2, 3, NAN};
+
+// Incremental against Evaluator over random expressions and variable edits,
+// and Evaluator against the exact rules for integral expressions.
+static bool differential(int count) {
+  Generator generator(1);
+  std::mt19937 random(2);
+  int failures = 0;
+  auto fail = [&](const std::string& text, const std::string& what) {
+    if (++failures <= 10) {
+      std::printf("  %s\n    %s\n", text.substr(0, 200).c_str(), what.c_str());
+    }
+  };
+
+  for (int n = 0; n < count; ++n) {
+    bool integral = n % 4 == 0;
+    Generated generated =
+        integral ? generator.integral(4) : generator.expression(5);
+    // Now and then a long one, so that cancelling midway leaves work over
+    bool long_one = n % 1000 == 999;
+    if (long_one) {
+      for (int i = 0; i < 10000; ++i) {
+        generated.text += " + " + generator.expression(4).text;
+      }
+    }
+
+    auto expr = parseString(generated.text);
+    if (!expr) {
+      fail(generated.text, "doesn't parse: " +
+                               std::string(errorToString(expr.error())));
+      continue;
+    }
+
+    if (long_one) {
+      std::atomic<bool> cancelled = true;
+      auto got = Incremental(**expr, &cancelled).evaluate({});
+      if (got || got.error() != Expr::Error::Cancelled) {
+        fail(generated.text, "built despite cancelling: " + show(got));
+      }
+    }
+
+    Evaluator evaluator;
+    Incremental incremental(**expr);
+    std::map<std::string, double> variables;
+    for (int step = 0; step < 8; ++step) {
+      const char* name = kVariables[random() % std::size(kVariables)];
+      if (random() % 5 == 0) {
+        variables.erase(name);
+      } else {
+        variables[name] = kValues[random() % std::size(kValues)];
+      }
+
+      auto expected = evaluator.evaluate(**expr, variables);
+      // A cancelled call leaves its work to the next one.
+      Evaluator::Result got = std::unexpected(Expr::Error::Cancelled);
+      if (long_one) {
+        std::atomic<bool> cancelled = true;
+        got = incremental.evaluate(variables, &cancelled);
+      }
+      if (!got && got.error() == Expr::Error::Cancelled) {
+        got = incremental.evaluate(variables);
+      }
+      if (!same(got, expected)) {
+        fail(generated.text,
+             "incremental " + show(got) + ", evaluator " + show(expected));
+        break;
+      }
+    }
+
+    if (integral) {
+      auto result = evaluator.evaluate(**expr, {});
+      if (!same(result, generated.value)) {
+        fail(generated.text, "evaluator " + show(result) + ", expected " +
+                                 show(generated.value));
+      }
+    }
+  }
+
+  std::printf("differential: %d expressions, %d failures\n", count, failures);
+  return failures == 0;
+}
+
+// Expressions with known results, for what random ones rarely reach
+static const struct {
+  const char* text;
+  Evaluator::Result expected;
+} kCases[] = {
+    // A step that fails exactly leaves its exact operands alone, even
+    // those a double can't hold
+    {"(1/2) + ((4611686018427387904+1) - 4611686018427387904)", 1.5},
+    {"2^-1 + ((4611686018427387904+1) - 4611686018427387904)", 1.5},
+    {"(9007199254740993 - 9007199254740992) / 2", 0.5},
+    {"(4611686018427387904 * 2) - 4611686018427387904", 0x1p62},
+    {"1 ? 9007199254740993 : 1/2", std::int64_t{9007199254740993}},
+    {"(1/2) ? 9007199254740993 : 0", 0x1p53},
+    {"1/0 + 9007199254740993", std::unexpected(Expr::Error::DivisionByZero)},
+
+    // Precedence and associativity, which the generator's parentheses hide
+    {"1 ? 2 : 0 ? 3 : 4", std::int64_t{2}},
+    {"1 ? 0 : 1 ? 3 : 4", std::int64_t{0}},
+    {"0 ? 1 : 0 ? 2 : 3", std::int64_t{3}},
+    {"0 || 1 && 0", std::int64_t{0}},
+    {"1 || 1 && 0", std::int64_t{1}},
+    {"0 && 1 || 1", std::int64_t{1}},
+    {"0 || 1 ? 5 : 6", std::int64_t{5}},
+    {"1 < 2 == 1", std::int64_t{1}},
+    {"2 == 2 < 3", std::int64_t{0}},
+    {"2 <= 1 == 0", std::int64_t{1}},
+    {"3 > 2 > 1", std::int64_t{0}},
+    {"1 + 1 ? 5 : 6", std::int64_t{5}},
+    {"1 - 1 ? 5 : 6", std::int64_t{6}},
+    {"1 == 1 && 2 < 3", std::int64_t{1}},
+    {"1 ? 2", std::unexpected(Expr::Error::InvalidExpression)},
+    {"1 ? 2 : 3 : 4", std::unexpected(Expr::Error::InvalidExpression)},
+    {"1 ? : 3", std::unexpected(Expr::Error::InvalidExpression)},
+    {"? 1 : 2", std::unexpected(Expr::Error::InvalidExpression)},
+    {"1 &&", std::unexpected(Expr::Error::InvalidExpression)},
+    {"1 & 2", std::unexpected(Expr::Error::InvalidExpression)},
+    {"1 < < 2", std::unexpected(Expr::Error::InvalidExpression)},
+};
+
+static bool cases() {
+  int failures = 0;
+  for (const auto& [text, expected] : kCases) {
+    auto expr = parseString(text);
+    Evaluator::Result got = expr ? Evaluator().evaluate(**expr, {})
+                                 : std::unexpected(expr.error());
+    if (!same(got, expected)) {
+      failures++;
+      std::printf("  %s\n    got %s, expected %s\n", text, show(got).c_str(),
+                  show(expected).c_str());
+    }
+  }
+  std::printf("cases: %zu expressions, %d failures\n", std::size(kCases),
+              failures);
+  return failures == 0;
+}
+
+// evaluateAs in float and long double, which the app doesn't use yet:
+// literals are rounded straight to the type and builtins run in it, and sum
+// bounds must be exact in it.
+static bool precision() {
+  using Expected = std::expected<AnyValue, Expr::Error>;
+  const struct {
+    Precision precision;
+    const char* text;
+    Expected expected;
+  } checks[] = {
+      {Precision::LongDouble, "0.1", 0.1L},
+      {Precision::Double, "0.1", 0.1},
+      {Precision::Float, "0.1", 0.1f},
+      {Precision::LongDouble, "1/3", 1.0L / 3},
+      {Precision::LongDouble, "sqrt(2)", std::sqrt(2.0L)},
+      {Precision::Float, "sqrt(2)", std::sqrt(2.0f)},
+      {Precision::Float, "16777217", std::int64_t{16777217}},
+      {Precision::Float, "16777217 + 0.5", 16777216.0f},
+      {Precision::Float, "sum(i, 8388600, 8388608, 1)", 9.0f},
+      {Precision::Float, "sum(i, 1, 8388609, 1)",
+       std::unexpected(Expr::Error::InvalidRange)},
+      {Precision::Double, "sum(i, 8388600, 8388609, 1)", 10.0},
+  };
+
+  auto show = [](const Expected& value) {
+    if (!value) return std::string(errorToString(value.error()));
+    char text[48];
+    std::visit(
+        [&](auto v) {
+          std::snprintf(text, sizeof(text), "%.21Lg (alternative %zu)",
+                        static_cast<long double>(v), value->index());
+        },
+        *value);
+    return std::string(text);
+  };
+
+  int failures = 0;
+  for (const auto& [precision, text, expected] : checks) {
+    auto expr = parseString(text);
+    Expected got = expr ? evaluateAs(precision, **expr, {})
+                        : std::unexpected(expr.error());
+    if (got != expected) {
+      failures++;
+      std::printf("  %s\n    got %s, expected %s\n", text, show(got).c_str(),
+                  show(expected).c_str());
+    }
+  }
+  std::printf("precision: %zu expressions, %d failures\n", std::size(checks),
+              failures);
+  return failures == 0;
+}
+
+// Sums and products combine their chunks in a fixed order, so the thread
+// count mustn't change a single bit, errors included.
+static bool threadCounts() {
+  const char* texts[] = {
+      "sum(i, 1, 1000000, 1/i)",
+      "sum(i, 1, 1000000, sin(i))",  // Batch kernel
+      "prod(i, 1, 1000000, 1 + 1/(i*i + 1))",
+      "sum(i, 1, 20, sum(j, 1, 100000, 1/(i + j)))",
+      "sum(i, -500000, 500000, 1/i)",
+  };
+
+  int failures = 0;
+  for (const char* text : texts) {
+    auto expr = parseString(text);
+    auto alone = Evaluator(1).evaluate(**expr, {});
+    for (size_t threads : {2, 3, 8}) {
+      auto got = Evaluator(threads).evaluate(**expr, {});
+      if (!same(got, alone)) {
+        failures++;
+        std::printf("  %s\n    %zu threads %s, one thread %s\n", text, threads,
+                    show(got).c_str(), show(alone).c_str());
+      }
+    }
+  }
+  std::printf("threads: %zu expressions, %d failures\n", std::size(texts),
+              failures);
+  return failures == 0;
+}
+
+// Random edits on the gap buffer and on a plain string with a cursor,
+// which must agree after every step.
+static bool editorCheck() {
+  constexpr int kSteps = 200000;
+  std::mt19937 random(3);
+  Editor editor;
+  std::string model;
+  size_t cursor = 0;
+  int failures = 0;
+
+  for (int step = 0; step < kSteps && failures < 10; ++step) {
+    const char* what;
+    switch (random() % 16) {
+      case 0:
+      case 1:
+      case 2:
+      case 3:
+      case 4: {
+        what = "insert";
+        // Mostly typing, now and then a paste long enough to grow the gap
+        size_t length = random() % 200 == 0 ? random() % 5000 : random() % 4;
+        std::string text(length, 'a');
+        for (char& c : text) c = static_cast<char>('a' + random() % 26);
+        editor.insert(text);
+        model.insert(cursor, text);
+        cursor += length;
+        break;
+      }
+      case 5:
+      case 6:
+      case 7:
+        what = "erase";
+        editor.erase();
+        if (cursor > 0) model.erase(--cursor, 1);
+        break;
+      case 8:
+      case 9:
+        what = "eraseForward";
+        editor.eraseForward();
+        if (cursor < model.size()) model.erase(cursor, 1);
+        break;
+      case 10:
+        what = "clear";
+        if (random() % 20 != 0) continue;
+        editor.clear();
+        model.clear();
+        cursor = 0;
+        break;
+      default: {
+        what = "moveTo";
+        // Near the cursor mostly, and sometimes past the end
+        size_t position = random() % 4 == 0 ? random() % (model.size() + 10)
+                                            : cursor + random() % 21;
+        position = position < 10 ? 0 : position - 10;
+        editor.moveTo(position);
+        cursor = std::min(position, model.size());
+        break;
+      }
+    }
+
+    bool ok = editor.size() == model.size() && editor.cursor() == cursor &&
+              editor.empty() == model.empty() && editor.text() == model;
+    for (size_t i = 0; ok && i < model.size(); i += 1 + random() % 8) {
+      ok = editor[i] == model[i];
+    }
+    if (!ok) {
+      failures++;
+      std::printf("  step %d, %s: size %zu, cursor %zu; expected %zu, %zu\n",
+                  step, what, editor.size(), editor.cursor(), model.size(),
+                  cursor);
+    }
+  }
+
+  std::printf("editor: %d edits, %d failures\n", kSteps, failures);
+  return failures == 0;
+}
+
+// Every edit keeps a and b equal, and the first writer only ever raises
+// them, so a reader must never see them differ or go back.
+static bool storeCheck() {
+  constexpr int kReaders = 8;
+  constexpr int kEdits = 20000;
+  VariableStore store;
+  store.assign({{"a", 0}, {"b", 0}});
+  std::atomic<bool> done = false;
+  std::atomic<int> failures = 0;
+
+  std::vector<std::thread> threads;
+  for (int i = 0; i < kReaders; ++i) {
+    threads.emplace_back([&] {
+      double last = 0;
+      while (!done.load()) {
+        auto first = store.snapshot();
+        auto second = store.snapshot();  // Taken later, so no older
+        VariableStore::Snapshot moved = std::move(first);
+        double a = moved->at("a");
+        if (a != moved->at("b") || a < last || second->at("a") < a) {
+          failures++;
+        }
+        last = a;
+      }
+    });
+  }
+  // A second writer edits around the first one's edits.
+  threads.emplace_back([&] {
+    for (int i = 0; !done.load(); ++i) {
+      if (i % 2 == 0) {
+        store.set("c", i);
+      } else {
+        store.erase("c");
+      }
+    }
+  });
+
+  for (int i = 1; i <= kEdits; ++i) {
+    store.assign({{"a", i}, {"b", i}});
+  }
+  done = true;
+  for (std::thread& thread : threads) thread.join();
+
+  std::printf("store: %d readers, %d edits, %d failures\n", kReaders, kEdits,
+              failures.load());
+  return failures == 0;
+}
+
+int main(int argc, char** argv) {
+  const struct {
+    const char* name;
+    bool (*run)();
+  } checks[] = {{"vmath", vmathCheck},
+                {"differential", [] { return differential(20000); }},
+                {"cases", cases},
+                {"precision", precision},
+                {"threads", threadCounts},
+                {"editor", editorCheck},
+                {"store", storeCheck}};
+
+  bool ok = true;
+  for (const auto& check : checks) {
+    bool selected = argc == 1;
+    for (int i = 1; i < argc; ++i) {
+      selected |= std::strcmp(argv[i], check.name) == 0;
+    }
+    if (selected) ok &= check.run();
+  }
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,336 @@
+// Headless frame-cost benchmark for ui::calculator and ui::variableTable.
+//
+// Builds the ImGui frame exactly as the app does, but with no platform or
+// renderer backend: the app's baked font atlas is installed and draw data is
+// generated and dropped. Runs without a display or GPU.
+//
+// Times are per frame; the allocation columns count operator new and ImGui
+// allocations per frame made on the UI thread. The worker's and the sum
+// helpers' allocations aren't part of a frame's cost.
+//
+// It also times startup up to the first frame with the fonts rasterized from
+// BENCH_FONT, the TTF the atlas was baked from, against the baked atlas.
+
+#include <imgui.h>
+#include <time.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../src/editor.cc"
+#include "../src/evaluator.cc"
+#include "../src/font.cc"
+#include "../src/functions.cc"
+#include "../src/incremental.cc"
+#include "../src/parser.cc"
+#include "../src/printer.cc"
+#include "../src/stack.cc"
+#include "../src/state.cc"
+#include "../src/ui.cc"
+#include "../src/variables.cc"
+#include "../src/vmath.cc"
+#include "../src/worker.cc"
+
+// Only touched by the thread running measure, while it is counting
+static size_t allocations = 0;
+static size_t allocated_bytes = 0;
+static thread_local bool counting = false;
+
+static void* countedAlloc(size_t size) {
+  if (counting) {
+    allocations++;
+    allocated_bytes += size;
+  }
+  return std::malloc(size ? size : 1);
+}
+
+void* operator new(size_t size) {
+  if (void* ptr = countedAlloc(size)) return ptr;
+  throw std::bad_alloc();
+}
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+void operator delete(void* ptr, size_t) noexcept { std::free(ptr); }
+
+static void* imguiAlloc(size_t size, void*) { return countedAlloc(size); }
+static void imguiFree(void* ptr, void*) { std::free(ptr); }
+
+static double threadCpuMicros() {
+  timespec ts;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  return static_cast<double>(ts.tv_sec) * 1e6 +
+         static_cast<double>(ts.tv_nsec) / 1e3;
+}
+
+static constexpr size_t kWorkspaceSizes[] = {0, 10, 100, 1000, 10000, 100000};
+
+static void createContext() {
+  ImGui::SetAllocatorFunctions(imguiAlloc, imguiFree);
+  ImGui::CreateContext();
+  ImGuiIO& io = ImGui::GetIO();
+  io.IniFilename = nullptr;
+  io.LogFilename = nullptr;
+  io.DisplaySize = ImVec2(200, 340);
+  io.DeltaTime = 1.0f / 60.0f;
+  ImGui::StyleColorsDark();
+}
+
+// Builds the atlas if it isn't yet and converts it to RGBA, as the OpenGL
+// backend does before its first frame.
+static void uploadAtlas() {
+  unsigned char* pixels;
+  int width, height;
+  ImGui::GetIO().Fonts->GetTexDataAsRGBA32(&pixels, &width, &height);
+}
+
+// How the app loaded its fonts before they were baked.
+static Fonts loadTtf(ImFontAtlas* atlas) {
+  ImFontConfig font_config;
+  font_config.OversampleH = 2;
+  font_config.OversampleV = 2;
+  font_config.SizePixels = 28.0f;
+  ImFont* large = atlas->AddFontFromFileTTF(BENCH_FONT, 28.0f, &font_config);
+  font_config.SizePixels = 18.0f;
+  ImFont* button = atlas->AddFontFromFileTTF(BENCH_FONT, 18.0f, &font_config);
+  return {large, button};
+}
+
+// From a fresh context to the end of the first frame's Render.
+template <typename Load>
+static double firstFrameMillis(Load load) {
+  createContext();
+  State state;
+  auto start = std::chrono::steady_clock::now();
+  Fonts fonts = load(ImGui::GetIO().Fonts);
+  uploadAtlas();
+  ImGui::NewFrame();
+  ui::calculator(state, 200, 340, fonts.large, fonts.button);
+  ImGui::Render();
+  std::chrono::duration<double, std::milli> elapsed =
+      std::chrono::steady_clock::now() - start;
+  ImGui::DestroyContext();
+  return elapsed.count();
+}
+
+static void timeStartup(int starts) {
+  std::vector<double> ttf, baked;
+  for (int i = 0; i < starts; ++i) {
+    ttf.push_back(firstFrameMillis(loadTtf));
+    baked.push_back(firstFrameMillis(loadBakedFonts));
+  }
+  std::sort(ttf.begin(), ttf.end());
+  std::sort(baked.begin(), baked.end());
+  std::printf("first frame after %.2f ms rasterizing %s, %.2f ms baked "
+              "(median of %d starts)\n",
+              ttf[ttf.size() / 2], BENCH_FONT, baked[baked.size() / 2], starts);
+}
+
+// Presses the button at column, row of the grid on even frames and releases
+// it on odd ones.
+static void click(int column, int row, int frame) {
+  ImGuiIO& io = ImGui::GetIO();
+  io.AddMousePosEvent(31.0f + 46.0f * static_cast<float>(column),
+                      110.0f + 52.0f * static_cast<float>(row));
+  io.AddMouseButtonEvent(0, frame % 2 == 0);
+}
+
+// Clicks sweep the button grid: press on one frame, release on the next.
+static void scriptInput(int frame) {
+  int index = frame / 2;
+  click(index % 4, (index / 4) % 5, frame);
+}
+
+// Clicks sweep only the digits and the operators beside them, so they keep
+// typing at the cursor without clearing or evaluating.
+static void typeInput(int frame) {
+  int index = frame / 2;
+  click(index % 4, 1 + (index / 4) % 3, frame);
+}
+
+// Runs frames of the calculator untimed, plus one to take the last
+// release: input queued during a frame only lands on the next.
+template <typename Input>
+static void replay(State& state, const Fonts& fonts, int frames,
+                   Input input) {
+  for (int i = 0; i <= frames; ++i) {
+    ImGui::NewFrame();
+    if (i < frames) input(i);
+    state.poll();
+    ui::calculator(state, 200, 340, fonts.large, fonts.button);
+    ImGui::Render();
+  }
+}
+
+static void waitFor(State& state) {
+  while (state.computing()) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    state.poll();
+  }
+}
+
+static bool expect(const char* scenario, const std::string& got,
+                   const char* want) {
+  if (got == want) return true;
+  std::fprintf(stderr, "%s: clicks gave \"%s\", expected \"%s\"\n",
+               scenario, got.c_str(), want);
+  return false;
+}
+
+// The timings mean nothing if the scripted clicks miss their buttons, say
+// after a layout change, so check what each script types first.
+static bool checkClicks(const Fonts& fonts) {
+  // One sweep of the grid: C, +/- and Var change nothing in the text.
+  State swept;
+  replay(swept, fonts, 40, scriptInput);
+  waitFor(swept);
+  bool ok = expect("calculator", swept.editor.text(), "%/789*456-123+0.");
+
+  State typed;
+  replay(typed, fonts, 24, typeInput);
+  ok &= expect("pasted", typed.editor.text(), "789*456-123+");
+  replay(typed, fonts, 4, [](int i) {
+    if (i < 2) {
+      click(0, 3, i);  // 1
+    } else {
+      click(3, 4, i);  // =
+    }
+  });
+  waitFor(typed);
+  ok &= expect("equals", typed.display, "359662");
+  return ok;
+}
+
+struct Report {
+  std::vector<double> wall_us;
+  double cpu_us = 0;
+  size_t allocations = 0;
+  size_t bytes = 0;
+};
+
+template <typename Frame>
+static Report measure(int frames, Frame frame) {
+  Report report;
+  report.wall_us.reserve(static_cast<size_t>(frames));
+  double cpu_start = threadCpuMicros();
+  size_t allocations_start = allocations;
+  size_t bytes_start = allocated_bytes;
+  counting = true;
+
+  for (int i = 0; i < frames; ++i) {
+    auto start = std::chrono::steady_clock::now();
+    ImGui::NewFrame();
+    frame(i);
+    ImGui::Render();
+    std::chrono::duration<double, std::micro> elapsed =
+        std::chrono::steady_clock::now() - start;
+    report.wall_us.push_back(elapsed.count());
+  }
+
+  counting = false;
+  report.cpu_us = threadCpuMicros() - cpu_start;
+  report.allocations = allocations - allocations_start;
+  report.bytes = allocated_bytes - bytes_start;
+  return report;
+}
+
+static void print(const char* scenario, size_t vars, const Report& report) {
+  std::vector<double> sorted = report.wall_us;
+  std::sort(sorted.begin(), sorted.end());
+  double frames = static_cast<double>(sorted.size());
+  double total = 0;
+  for (double us : sorted) total += us;
+  std::printf("%-10s %7zu %7zu %9.1f %9.1f %9.1f %9.1f %9.1f %11.1f\n",
+              scenario, vars, sorted.size(), total / frames,
+              sorted[sorted.size() / 2], sorted[sorted.size() * 99 / 100],
+              report.cpu_us / frames,
+              static_cast<double>(report.allocations) / frames,
+              static_cast<double>(report.bytes) / frames);
+}
+
+int main(int argc, char** argv) {
+  int frames = argc > 1 ? std::atoi(argv[1]) : 600;
+  createContext();
+  Fonts fonts = loadBakedFonts(ImGui::GetIO().Fonts);
+  uploadAtlas();
+  if (!checkClicks(fonts)) return 1;
+
+  std::printf("%-10s %7s %7s %9s %9s %9s %9s %9s %11s\n", "scenario", "vars",
+              "frames", "mean_us", "p50_us", "p99_us", "cpu_us", "allocs",
+              "bytes");
+
+  // Warm up so first-use allocations inside ImGui don't skew the numbers.
+  State warmup;
+  measure(60, [&](int) {
+    ui::calculator(warmup, 200, 340, fonts.large, fonts.button);
+  });
+
+  for (size_t vars : kWorkspaceSizes) {
+    State state;
+    VariableStore::Map workspace;
+    for (size_t i = 0; i < vars; ++i) {
+      workspace["v" + std::to_string(i)] = static_cast<double>(i);
+    }
+    state.variables.assign(std::move(workspace));
+
+    // Keep the slow cases bounded while still averaging over a few frames.
+    int scaled = std::max(10, frames / static_cast<int>(1 + vars / 1000));
+
+    print("calculator", vars, measure(frames, [&](int i) {
+            scriptInput(i);
+            state.poll();
+            ui::calculator(state, 200, 340, fonts.large, fonts.button);
+          }));
+    print("variables", vars, measure(scaled, [&](int) {
+            ui::variableTable(state, 200, 340, fonts.large, fonts.button);
+          }));
+  }
+
+  // A pasted 10 MB expression should cost no more per frame than a short
+  // one; the clicks keep typing at its end.
+  State pasted;
+  std::string text = "12";
+  while (text.size() < (10 << 20)) text += "+12";
+  auto start = std::chrono::steady_clock::now();
+  pasted.insert(text);
+  std::chrono::duration<double, std::micro> paste =
+      std::chrono::steady_clock::now() - start;
+  print("pasted", 0, measure(frames, [&](int i) {
+          typeInput(i);
+          pasted.poll();
+          ui::calculator(pasted, 200, 340, fonts.large, fonts.button);
+        }));
+  std::printf("pasting %zu bytes took %.1f us\n", text.size(), paste.count());
+
+  // Then evaluate it: release whatever typing left pressed, end on a digit
+  // in case it stopped after an operator, and press =.
+  start = std::chrono::steady_clock::now();
+  print("equals", 0, measure(5, [&](int i) {
+          if (i < 3) {
+            click(0, 3, i + 1);  // 1
+          } else {
+            click(3, 4, i + 1);  // =
+          }
+          pasted.poll();
+          ui::calculator(pasted, 200, 340, fonts.large, fonts.button);
+        }));
+  // Frames keep coming while the worker evaluates, as they would in the app.
+  print("evaluating", 0, measure(frames, [&](int) {
+          pasted.poll();
+          ui::calculator(pasted, 200, 340, fonts.large, fonts.button);
+        }));
+  waitFor(pasted);
+  std::chrono::duration<double, std::milli> evaluation =
+      std::chrono::steady_clock::now() - start;
+  std::printf("evaluating it took %.1f ms: %s\n", evaluation.count(),
+              pasted.display.c_str());
+
+  ImGui::DestroyContext();
+
+  timeStartup(11);
+  return 0;
+}
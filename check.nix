@@ -0,0 +1,57 @@
+{
+  lib,
+  stdenv,
+  llvm,
+  ...
+}:
+let
+  flags = [
+    "--start-no-unused-arguments"
+    "-std=c++23"
+    "-O2"
+    "-stdlib=libc++"
+    "-fstrict-enums"
+    "-fno-operator-names"
+    "-fno-common"
+    "-fno-math-errno"
+    "-Wall"
+    "-Wconversion"
+  ];
+in
+stdenv.mkDerivation {
+  pname = "clack-check";
+  version = "0.1.0";
+  src = lib.fileset.toSource {
+    root = ./.;
+    fileset = lib.fileset.unions [
+      ./src
+      ./bench
+    ];
+  };
+
+  buildInputs = [ llvm.libcxx ];
+
+  FLAGS = flags ++ [
+    "-fsanitize=undefined"
+    "-fsanitize=address"
+  ];
+  # ThreadSanitizer doesn't combine with AddressSanitizer.
+  TSAN_FLAGS = flags ++ [ "-fsanitize=thread" ];
+
+  buildPhase = ''
+    $CXX bench/check.cc -o clack-check $FLAGS
+    $CXX bench/check.cc -o clack-check-tsan $TSAN_FLAGS
+  '';
+
+  doCheck = true;
+  checkPhase = ''
+    ./clack-check
+    ./clack-check-tsan store threads
+  '';
+
+  installPhase = ''
+    install -D -t $out/bin clack-check clack-check-tsan
+  '';
+
+  meta.mainProgram = "clack-check";
+}
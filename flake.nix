@@ -6,7 +6,11 @@
   outputs =
     inputs@{ parts, ... }:
     parts.lib.mkFlake { inherit inputs; } {
-      systems = [ "aarch64-darwin" ];
+      systems = [
+        "aarch64-darwin"
+        "aarch64-linux"
+        "x86_64-linux"
+      ];
       perSystem =
         { pkgs, config, ... }:
         let
@@ -15,6 +19,9 @@
         in
         {
           packages.clack = pkgs.callPackage ./package.nix { inherit stdenv llvm; };
+          packages.ui-bench = pkgs.callPackage ./bench.nix { inherit stdenv llvm; };
+          packages.check = pkgs.callPackage ./check.nix { inherit stdenv llvm; };
+          checks.default = config.packages.check;
 
           devShells.default = pkgs.mkShell.override { inherit stdenv; } {
             packages = [ (pkgs.ccls.override { llvmPackages = llvm; }) ];
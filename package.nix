@@ -4,6 +4,9 @@
   llvm,
   imgui,
   glfw,
+  jetbrains-mono,
+  # Baked into the binary at build time, see tools/bake_font.cc
+  font ? "${jetbrains-mono}/share/fonts/truetype/JetBrainsMono-Regular.ttf",
   ...
 }:
 stdenv.mkDerivation {
@@ -11,7 +14,10 @@ stdenv.mkDerivation {
   version = "0.1.0";
   src = lib.fileset.toSource {
     root = ./.;
-    fileset = lib.fileset.unions [ ./src ];
+    fileset = lib.fileset.unions [
+      ./src
+      ./tools
+    ];
   };
 
   outputs = [
@@ -28,6 +34,7 @@ stdenv.mkDerivation {
   FLAGS = [
     "--start-no-unused-arguments"
     "-std=c++23"
+    "-O2"
     "-stdlib=libc++"
     "-fstrict-enums"
     "-fsanitize=undefined"
@@ -35,12 +42,17 @@ stdenv.mkDerivation {
     "-flto"
     "-fno-operator-names"
     "-fno-common"
+    # Lets sqrt compile to the instruction, so the vmath loops vectorize
+    "-fno-math-errno"
     "-fvisibility=hidden"
     "-Wall"
     "-Wconversion"
   ];
 
   buildPhase = ''
+    $CXX tools/bake_font.cc -limgui -o bake_font $FLAGS
+    ./bake_font ${font} src/font_atlas.inc
+
     $CXX src/main.cc -limgui -lglfw \
                      ${lib.optionalString stdenv.isDarwin "-framework OpenGL"} \
                      -o clack -MJ clack.o.json $FLAGS
@@ -1,7 +1,10 @@
 #include "app.hh"
 
+#include <cctype>
 #include <iostream>
+#include <string>
 
+#include "font.hh"
 #include "parser.hh"
 #include "ui.hh"
 
@@ -37,23 +40,10 @@ void App::run() {
     ImGui_ImplOpenGL3_NewFrame();
     ImGui_ImplGlfw_NewFrame();
     ImGui::NewFrame();
+    state.poll();
 
     if (!state.show_var_table) {
-      const ImGuiIO& io = ImGui::GetIO();
-      for (int i = 0; i < io.InputQueueCharacters.Size; ++i) {
-        ImWchar c = io.InputQueueCharacters[i];
-        if ((c >= '0' && c <= '9') || c == '+' || c == '-' || c == '*' ||
-            c == '/' || c == '(' || c == ')' || c == '.' ||
-            (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z')) {
-          state.updateExpression(state.expression + static_cast<char>(c));
-        } else if (c == 8 && !state.expression.empty()) {
-          state.updateExpression(
-              state.expression.substr(0, state.expression.size() - 1));
-        } else if (c == 27) {
-          state.updateExpression("");
-        }
-      }
-      const_cast<ImGuiIO&>(io).InputQueueCharacters.resize(0);
+      handleInput();
     }
 
     if (state.show_var_table) {
@@ -75,6 +65,49 @@ void App::run() {
   }
 }
 
+void App::handleInput() {
+  ImGuiIO& io = ImGui::GetIO();
+  for (int i = 0; i < io.InputQueueCharacters.Size; ++i) {
+    ImWchar c = io.InputQueueCharacters[i];
+    if ((c >= '0' && c <= '9') || c == '+' || c == '-' || c == '*' ||
+        c == '/' || c == '(' || c == ')' || c == '.' || c == ',' ||
+        c == '<' || c == '>' || c == '=' || c == '!' || c == '&' ||
+        c == '|' || c == '?' || c == ':' || (c >= 'A' && c <= 'Z') ||
+        (c >= 'a' && c <= 'z')) {
+      char typed = static_cast<char>(c);
+      state.insert(std::string_view(&typed, 1));
+    }
+  }
+  io.InputQueueCharacters.resize(0);
+
+  // GLFW doesn't report control characters as text, so these come as keys.
+  if (ImGui::IsKeyPressed(ImGuiKey_Backspace)) state.erase();
+  if (ImGui::IsKeyPressed(ImGuiKey_Delete)) state.eraseForward();
+  if (ImGui::IsKeyPressed(ImGuiKey_Escape)) state.clear();
+
+  std::size_t cursor = state.editor.cursor();
+  if (ImGui::IsKeyPressed(ImGuiKey_LeftArrow) && cursor > 0) {
+    state.moveCursor(cursor - 1);
+  }
+  if (ImGui::IsKeyPressed(ImGuiKey_RightArrow)) state.moveCursor(cursor + 1);
+  if (ImGui::IsKeyPressed(ImGuiKey_Home)) state.moveCursor(0);
+  if (ImGui::IsKeyPressed(ImGuiKey_End)) {
+    state.moveCursor(state.editor.size());
+  }
+
+  // Pasted text goes in whole, minus line breaks and anything else that
+  // isn't printable ASCII; the parser reports whatever it can't use.
+  if (ImGui::IsKeyChordPressed(ImGuiMod_Ctrl | ImGuiKey_V)) {
+    if (const char* clipboard = ImGui::GetClipboardText()) {
+      std::string text;
+      for (const char* c = clipboard; *c; ++c) {
+        if (std::isprint(static_cast<unsigned char>(*c))) text += *c;
+      }
+      state.insert(text);
+    }
+  }
+}
+
 bool App::initializeGlfw() {
   glfwSetErrorCallback([](int error, const char* description) {
     std::cerr << "GLFW Error " << error << ": " << description << std::endl;
@@ -111,17 +144,9 @@ void App::setupImGui() {
   ImGui::CreateContext();
   ImGuiIO& io = ImGui::GetIO();
 
-  ImFontConfig font_config;
-  font_config.OversampleH = 2;
-  font_config.OversampleV = 2;
-  font_config.SizePixels = 28.0f;
-
-  large_font = io.Fonts->AddFontFromFileTTF(
-      "/System/Library/Fonts/SFNSMono.ttf", 28.0f, &font_config);
-
-  font_config.SizePixels = 18.0f;
-  button_font = io.Fonts->AddFontFromFileTTF(
-      "/System/Library/Fonts/SFNSMono.ttf", 18.0f, &font_config);
+  Fonts fonts = loadBakedFonts(io.Fonts);
+  large_font = fonts.large;
+  button_font = fonts.button;
 
   ImGui::StyleColorsDark();
   ImGuiStyle& style = ImGui::GetStyle();
@@ -133,24 +158,3 @@ void App::setupImGui() {
   ImGui_ImplGlfw_InitForOpenGL(window, true);
   ImGui_ImplOpenGL3_Init(glsl_version);
 }
-
-void App::State::updateExpression(const std::string& new_expr) {
-  expression = new_expr;
-  display = expression.empty() ? "0" : expression;
-}
-
-void App::State::evaluate() {
-  auto parseResult = parseString(expression);
-  if (!parseResult) {
-    display = errorToString(parseResult.error());
-    return;
-  }
-  auto evalResult = evaluator.evaluate(*parseResult.value());
-  if (evalResult) {
-    display = std::to_string(*evalResult);
-    display.erase(display.find_last_not_of('0') + 1, std::string::npos);
-    if (display.back() == '.') display.pop_back();
-  } else {
-    display = errorToString(evalResult.error());
-  }
-}
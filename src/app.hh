@@ -8,8 +8,7 @@
 
 #include <string>
 
-#include "evaluator.hh"
-#include "printer.hh"
+#include "state.hh"
 
 class App {
  public:
@@ -19,16 +18,7 @@ class App {
   bool initialize();
   void run();
 
-  struct State {
-    std::string expression = "";
-    std::string display = "0";
-    bool show_var_table = false;
-    Evaluator evaluator;
-    Printer printer;
-
-    void updateExpression(const std::string& new_expr);
-    void evaluate();
-  };
+  using State = ::State;
 
   State& getState() { return state; }
   GLFWwindow* getWindow() { return window; }
@@ -48,4 +38,5 @@ class App {
   bool initializeGlfw();
   GLFWwindow* createWindow();
   void setupImGui();
+  void handleInput();
 };
@@ -0,0 +1,62 @@
+#include "editor.hh"
+
+#include <algorithm>
+
+void Editor::insert(std::string_view text) {
+  if (text.size() > gapSize()) {
+    // Grow geometrically so that typing stays amortized O(1) per character
+    std::size_t after = buffer.size() - gap_end;
+    std::size_t capacity =
+        std::max({buffer.size() * 2, size() + text.size(), std::size_t{64}});
+    buffer.resize(capacity);
+    std::copy_backward(buffer.begin() + static_cast<std::ptrdiff_t>(gap_end),
+                       buffer.begin() +
+                           static_cast<std::ptrdiff_t>(gap_end + after),
+                       buffer.end());
+    gap_end = capacity - after;
+  }
+
+  std::ranges::copy(text,
+                    buffer.begin() + static_cast<std::ptrdiff_t>(gap_begin));
+  gap_begin += text.size();
+}
+
+void Editor::erase() {
+  if (gap_begin > 0) gap_begin--;
+}
+
+void Editor::eraseForward() {
+  if (gap_end < buffer.size()) gap_end++;
+}
+
+void Editor::moveTo(std::size_t position) {
+  position = std::min(position, size());
+  auto at = [this](std::size_t i) {
+    return buffer.begin() + static_cast<std::ptrdiff_t>(i);
+  };
+
+  if (position < gap_begin) {
+    std::size_t count = gap_begin - position;
+    std::copy_backward(at(position), at(gap_begin), at(gap_end));
+    gap_begin -= count;
+    gap_end -= count;
+  } else if (position > gap_begin) {
+    std::size_t count = position - gap_begin;
+    std::copy(at(gap_end), at(gap_end + count), at(gap_begin));
+    gap_begin += count;
+    gap_end += count;
+  }
+}
+
+void Editor::clear() {
+  buffer.clear();
+  gap_begin = gap_end = 0;
+}
+
+std::string Editor::text() const {
+  std::string text;
+  text.reserve(size());
+  text.append(buffer.data(), gap_begin);
+  text.append(buffer.data() + gap_end, buffer.size() - gap_end);
+  return text;
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// The expression being typed, kept as a gap buffer: the text before the
+// cursor sits at the front of the buffer and the text after it at the back.
+// Typing, deleting and pasting at the cursor only touch the characters
+// involved, however long the expression is; moving the cursor by n
+// characters moves n characters across the gap.
+class Editor {
+ public:
+  std::size_t size() const { return buffer.size() - gapSize(); }
+  bool empty() const { return size() == 0; }
+  std::size_t cursor() const { return gap_begin; }
+
+  char operator[](std::size_t i) const {
+    return buffer[i < gap_begin ? i : i + gapSize()];
+  }
+
+  // At the cursor, which ends up after the inserted text
+  void insert(std::string_view text);
+  void erase();         // The character before the cursor, like backspace
+  void eraseForward();  // The character after the cursor, like delete
+  void moveTo(std::size_t position);  // Clamped to size()
+  void clear();
+
+  // Copies the whole expression; meant for evaluation, not for every frame
+  std::string text() const;
+
+ private:
+  std::vector<char> buffer;
+  std::size_t gap_begin = 0;
+  std::size_t gap_end = 0;
+
+  std::size_t gapSize() const { return gap_end - gap_begin; }
+};
@@ -1,43 +1,459 @@
 #include "evaluator.hh"
 
+#include <algorithm>
+#include <array>
 #include <cmath>
+#include <limits>
+#include <span>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
-using Result = Evaluator::Result;
+#include "worker.hh"
 
-Result Evaluator::evaluate(const Expr& expr) {
-  return std::visit([this](const auto& node) { return visit(node); },
-                    expr.node);
+using Exact = std::optional<std::int64_t>;
+
+static Exact power(std::int64_t base, std::int64_t exponent) {
+  if (exponent < 0) return std::nullopt;
+  std::int64_t result = 1;
+  // Exponentiation by squaring
+  while (exponent > 0) {
+    if (exponent & 1) {
+      if (__builtin_mul_overflow(result, base, &result)) return std::nullopt;
+    }
+    exponent >>= 1;
+    if (exponent > 0 && __builtin_mul_overflow(base, base, &base)) {
+      return std::nullopt;
+    }
+  }
+  return result;
 }
 
-void Evaluator::setVariable(const std::string& name, double value) {
-  variables[name] = value;
+// Fails whenever the exact result isn't an int64; division by zero included,
+// so the floating-point path reports it.
+static Exact applyExact(char op, std::int64_t left, std::int64_t right) {
+  constexpr std::int64_t min = std::numeric_limits<std::int64_t>::min();
+  std::int64_t result;
+  switch (op) {
+    case '+':
+      if (__builtin_add_overflow(left, right, &result)) return std::nullopt;
+      return result;
+    case '-':
+      if (__builtin_sub_overflow(left, right, &result)) return std::nullopt;
+      return result;
+    case '*':
+      if (__builtin_mul_overflow(left, right, &result)) return std::nullopt;
+      return result;
+    case '/':
+      if (right == 0 || (left == min && right == -1)) return std::nullopt;
+      if (left % right != 0) return std::nullopt;
+      return left / right;
+    case '%':
+      if (right == 0) return std::nullopt;
+      if (right == -1) return 0;
+      return left % right;
+    case '^':
+      return power(left, right);
+    case '<':
+      return left < right;
+    case 'l':
+      return left <= right;
+    case '>':
+      return left > right;
+    case 'g':
+      return left >= right;
+    case '=':
+      return left == right;
+    case '!':
+      return left != right;
+    default:
+      return std::nullopt;
+  }
 }
 
-void Evaluator::clearVariables() { variables.clear(); }
+// Whether an operand of && or || or a condition holds, as in finish
+template <typename V>
+static bool isTrue(V value) {
+  return value != 0;
+}
 
-Result Evaluator::visit(const Number& number) { return number.value; }
+template <typename T>
+static bool isTrue(const std::variant<std::int64_t, T>& value) {
+  auto exact = std::get_if<std::int64_t>(&value);
+  return exact ? *exact != 0 : *std::get_if<T>(&value) != 0;
+}
 
-Result Evaluator::visit(const Variable& variable) {
-  auto it = variables.find(variable.name);
+template <typename T>
+static T toReal(const std::variant<std::int64_t, T>& value) {
+  auto exact = std::get_if<std::int64_t>(&value);
+  return exact ? static_cast<T>(*exact) : *std::get_if<T>(&value);
+}
 
-  if (it == variables.end()) {
-    return std::unexpected(Expr::Error::UndefinedVariable);
+// The operand of expr to evaluate after the first next ones, whose values
+// are in done, or nullptr once expr can be computed. && and || and
+// conditionals skip the operands their result doesn't need, so errors there
+// are never reached.
+template <typename V>
+static const Expr* nextOperand(const Expr& expr, size_t next, const V* done) {
+  if (auto binary = std::get_if<Binary>(&expr.node)) {
+    if (next == 0) return binary->left.get();
+    return next == 1 ? binary->right.get() : nullptr;
+  }
+  if (auto unary = std::get_if<Unary>(&expr.node)) {
+    return next == 0 ? unary->operand.get() : nullptr;
   }
+  if (auto call = std::get_if<Call>(&expr.node)) {
+    return next < call->args.size() ? call->args[next].get() : nullptr;
+  }
+  if (auto aggregate = std::get_if<Aggregate>(&expr.node)) {
+    if (next == 0) return aggregate->from.get();
+    return next == 1 ? aggregate->to.get() : nullptr;
+  }
+  if (auto logical = std::get_if<Logical>(&expr.node)) {
+    if (next == 0) return logical->left.get();
+    bool decided = isTrue(done[0]) == (logical->op == '|');
+    return next == 1 && !decided ? logical->right.get() : nullptr;
+  }
+  if (auto conditional = std::get_if<Conditional>(&expr.node)) {
+    if (next == 0) return conditional->condition.get();
+    if (next > 1) return nullptr;
+    return isTrue(done[0]) ? conditional->then.get()
+                           : conditional->otherwise.get();
+  }
+  return nullptr;
+}
 
-  return it->second;
+// Exact counterpart of BasicEvaluator::finish
+static Exact finishExact(const Expr& expr, size_t count,
+                         const std::int64_t* operands) {
+  if (auto number = std::get_if<Number>(&expr.node)) return number->exact;
+  if (auto binary = std::get_if<Binary>(&expr.node)) {
+    return applyExact(binary->op, operands[0], operands[1]);
+  }
+  if (auto unary = std::get_if<Unary>(&expr.node)) {
+    if (unary->op == '+') return operands[0];
+    if (unary->op != '-') return std::nullopt;
+    return applyExact('-', 0, operands[0]);
+  }
+  if (std::holds_alternative<Logical>(expr.node)) {
+    return operands[count - 1] != 0;
+  }
+  if (std::holds_alternative<Conditional>(expr.node)) return operands[1];
+  return std::nullopt;
 }
 
-Result Evaluator::visit(const Binary& binary) {
-  auto left_result = evaluate(*binary.left);
-  if (!left_result) return left_result;
+// Iterations per chunk of a sum or product. Chunks are the unit of parallel
+// work and their results are combined pairwise in a fixed order, so the
+// result doesn't depend on the number of threads.
+static constexpr std::uint64_t kChunk = 1 << 14;
+// Chunks computed before their results are combined, which bounds the
+// memory a huge range needs.
+static constexpr std::uint64_t kRound = 1 << 12;
+
+// Combines a stream of values as ((a . b) . (c . d)) . ..., a shape that
+// depends only on the number of values.
+template <typename T>
+class Pairwise {
+ public:
+  explicit Pairwise(char op) : op(op) {}
+
+  void push(T value) {
+    unsigned level = 0;
+    while (!pending.empty() && pending.back().second == level) {
+      value = combine(pending.back().first, value);
+      pending.pop_back();
+      level++;
+    }
+    pending.emplace_back(value, level);
+  }
+
+  T result() const {
+    if (pending.empty()) return op == '+' ? T(0) : T(1);
+    T result = pending.back().first;
+    for (size_t i = pending.size() - 1; i-- > 0;) {
+      result = combine(pending[i].first, result);
+    }
+    return result;
+  }
+
+ private:
+  char op;
+  std::vector<std::pair<T, unsigned>> pending;  // Value and level
+
+  T combine(T left, T right) const {
+    return op == '+' ? left + right : left * right;
+  }
+};
+
+template <typename T>
+auto BasicEvaluator<T>::evaluate(const Expr& expr,
+                                 const std::map<std::string, double>& variables,
+                                 const std::atomic<bool>* cancelled) -> Result {
+  globals = &variables;
+  cancel_flag = cancelled;
+  stopped = false;
+  steps = 0;
+
+  if (expr.integral) return evaluateIntegral(expr);
+  return evaluateReal(expr);
+}
+
+template <typename T>
+bool BasicEvaluator<T>::checkCancelled() {
+  if (!stopped && cancel_flag && (++steps & 0xfff) == 0) {
+    stopped = cancel_flag->load(std::memory_order_relaxed);
+  }
+  return stopped;
+}
+
+// Subtrees at most this tall are evaluated by plain recursion, which is
+// faster than the explicit stacks below; taller ones are what a pasted
+// expression can contain, far deeper than any thread's stack.
+static constexpr size_t kMaxRecursion = 64;
+
+// Evaluates like a recursive walk would, but with the frames on the heap
+// once the tree is too tall. A sum evaluates its body by calling this
+// again, which works above the frames it finds.
+template <typename T>
+auto BasicEvaluator<T>::evaluateReal(const Expr& expr) -> Real {
+  if (expr.height <= kMaxRecursion) return recurse(expr);
+
+  size_t frames_base = frames.size();
+  size_t values_base = values.size();
+  auto fail = [&](Expr::Error error) -> Real {
+    frames.resize(frames_base);
+    values.resize(values_base);
+    return std::unexpected(error);
+  };
+
+  if (auto error = enter(expr)) return fail(*error);
+
+  while (frames.size() > frames_base) {
+    Frame& frame = frames.back();
+    const Expr& current = *frame.expr;
+
+    if (const Expr* operand =
+            nextOperand(current, frame.next, values.data() + frame.begin)) {
+      frame.next++;
+      if (auto error = enter(*operand)) return fail(*error);
+      continue;
+    }
+
+    // A sum re-enters, which may move the frames; keep what's needed.
+    size_t begin = frame.begin;
+    auto result = finish(current, frame.next, values.data() + begin);
+    if (!result) return fail(result.error());
+    values.resize(begin);
+    values.push_back(*result);
+    frames.pop_back();
+  }
+
+  T result = values.back();
+  values.pop_back();
+  return result;
+}
+
+template <typename T>
+auto BasicEvaluator<T>::recurse(const Expr& expr) -> Real {
+  if (checkCancelled()) return std::unexpected(Expr::Error::Cancelled);
+
+  if (auto number = std::get_if<Number>(&expr.node)) {
+    return number->as<T>();
+  }
+  if (auto variable = std::get_if<Variable>(&expr.node)) {
+    return lookup(*variable);
+  }
+  if (expr.integral) {
+    auto value = evaluateIntegral(expr);
+    if (!value) return std::unexpected(value.error());
+    return toReal(*value);
+  }
+  // The common operators skip the value stack.
+  if (auto binary = std::get_if<Binary>(&expr.node)) {
+    auto left = recurse(*binary->left);
+    if (!left) return left;
+    auto right = recurse(*binary->right);
+    if (!right) return right;
+    return apply(binary->op, *left, *right);
+  }
+  if (auto unary = std::get_if<Unary>(&expr.node)) {
+    auto operand = recurse(*unary->operand);
+    if (!operand) return operand;
+    return apply(unary->op, *operand);
+  }
+
+  size_t begin = values.size();
+  size_t next = 0;
+  while (const Expr* operand =
+             nextOperand(expr, next, values.data() + begin)) {
+    next++;
+    auto value = recurse(*operand);
+    if (!value) {
+      values.resize(begin);
+      return value;
+    }
+    values.push_back(*value);
+  }
+  auto result = finish(expr, next, values.data() + begin);
+  values.resize(begin);
+  return result;
+}
+
+// Pushes the value of expr when it is short enough to recurse into, or
+// integral, and otherwise a frame to evaluate it in.
+template <typename T>
+auto BasicEvaluator<T>::enter(const Expr& expr) -> std::optional<Expr::Error> {
+  if (expr.height <= kMaxRecursion) {
+    auto value = recurse(expr);
+    if (!value) return value.error();
+    values.push_back(*value);
+    return std::nullopt;
+  }
+  if (checkCancelled()) return Expr::Error::Cancelled;
+
+  if (expr.integral) {
+    auto value = evaluateIntegral(expr);
+    if (!value) return value.error();
+    values.push_back(toReal(*value));
+    return std::nullopt;
+  }
+  frames.push_back({&expr, 0, values.size()});
+  return std::nullopt;
+}
 
-  auto right_result = evaluate(*binary.right);
-  if (!right_result) return right_result;
+// Integral subtrees have only operators and integer literals, so they are
+// walked on their own, with values that are int64s until a node fails
+// exactly and in T from then on. Like evaluateReal, short subtrees are
+// recursed into and taller ones use a stack of their own.
+template <typename T>
+auto BasicEvaluator<T>::evaluateIntegral(const Expr& expr) -> Result {
+  if (expr.height <= kMaxRecursion) return recurseIntegral(expr);
 
-  double left = *left_result;
-  double right = *right_result;
+  integral_frames.clear();
+  integral_values.clear();
+  integral_frames.push_back({&expr, 0, 0});
 
-  switch (binary.op) {
+  while (!integral_frames.empty()) {
+    Frame& frame = integral_frames.back();
+    const Expr& current = *frame.expr;
+
+    if (const Expr* operand = nextOperand(
+            current, frame.next, integral_values.data() + frame.begin)) {
+      frame.next++;
+      if (operand->height <= kMaxRecursion) {
+        auto value = recurseIntegral(*operand);
+        if (!value) return value;
+        integral_values.push_back(*value);
+      } else {
+        integral_frames.push_back({operand, 0, integral_values.size()});
+      }
+      continue;
+    }
+
+    auto result = finishIntegral(current, frame.next,
+                                 integral_values.data() + frame.begin);
+    if (!result) return result;
+    integral_values.resize(frame.begin);
+    integral_values.push_back(*result);
+    integral_frames.pop_back();
+  }
+
+  return integral_values.back();
+}
+
+template <typename T>
+auto BasicEvaluator<T>::recurseIntegral(const Expr& expr) -> Result {
+  if (checkCancelled()) return std::unexpected(Expr::Error::Cancelled);
+  if (auto number = std::get_if<Number>(&expr.node)) return *number->exact;
+
+  std::array<Value, 3> operands;
+  size_t next = 0;
+  while (const Expr* operand = nextOperand(expr, next, operands.data())) {
+    auto value = recurseIntegral(*operand);
+    if (!value) return value;
+    operands[next++] = *value;
+  }
+  return finishIntegral(expr, next, operands.data());
+}
+
+// Exactly when every operand is exact and so is the result; otherwise in T,
+// which also reports errors such as division by zero.
+template <typename T>
+auto BasicEvaluator<T>::finishIntegral(const Expr& expr, size_t count,
+                                       const Value* operands) -> Result {
+  // The common case, without the copies below
+  if (auto binary = std::get_if<Binary>(&expr.node)) {
+    auto left = std::get_if<std::int64_t>(&operands[0]);
+    auto right = std::get_if<std::int64_t>(&operands[1]);
+    if (left && right) {
+      if (auto result = applyExact(binary->op, *left, *right)) return *result;
+    }
+    auto result =
+        apply(binary->op, toReal(operands[0]), toReal(operands[1]));
+    if (!result) return std::unexpected(result.error());
+    return *result;
+  }
+
+  std::array<std::int64_t, 3> exact{};  // At most a conditional's operands
+  size_t known = 0;
+  for (; known < count; ++known) {
+    auto value = std::get_if<std::int64_t>(&operands[known]);
+    if (!value) break;
+    exact[known] = *value;
+  }
+  if (known == count) {
+    if (auto result = finishExact(expr, count, exact.data())) return *result;
+  }
+
+  std::array<T, 3> real{};
+  for (size_t i = 0; i < count; ++i) real[i] = toReal(operands[i]);
+  auto result = finish(expr, count, real.data());
+  if (!result) return std::unexpected(result.error());
+  return *result;
+}
+
+// Computes expr, never a leaf, from the values of the count operands
+// nextOperand asked for.
+template <typename T>
+auto BasicEvaluator<T>::finish(const Expr& expr, size_t count,
+                               const T* operands) -> Real {
+  if (auto binary = std::get_if<Binary>(&expr.node)) {
+    return apply(binary->op, operands[0], operands[1]);
+  }
+  if (auto unary = std::get_if<Unary>(&expr.node)) {
+    return apply(unary->op, operands[0]);
+  }
+  if (auto call = std::get_if<Call>(&expr.node)) {
+    return call->function->apply<T>(std::span(operands, count));
+  }
+  if (auto sum = std::get_if<Aggregate>(&expr.node)) {
+    return aggregate(*sum, operands[0], operands[1]);
+  }
+  // Any nonzero value, NaN included, counts as true.
+  if (std::holds_alternative<Logical>(expr.node)) {
+    return static_cast<T>(operands[count - 1] != 0);
+  }
+  return operands[1];  // Conditional: the taken branch
+}
+
+template <typename T>
+auto BasicEvaluator<T>::lookup(const Variable& variable) const -> Real {
+  for (auto index = indices.rbegin(); index != indices.rend(); ++index) {
+    if (index->first == variable.name) return index->second;
+  }
+
+  auto it = globals->find(variable.name);
+
+  if (it == globals->end()) {
+    return std::unexpected(Expr::Error::UndefinedVariable);
+  }
+
+  return static_cast<T>(it->second);
+}
+
+template <typename T>
+auto BasicEvaluator<T>::apply(char op, T left, T right) -> Real {
+  switch (op) {
     case '+':
       return left + right;
     case '-':
@@ -45,25 +461,33 @@ Result Evaluator::visit(const Binary& binary) {
     case '*':
       return left * right;
     case '/':
-      if (right == 0.0) return std::unexpected(Expr::Error::DivisionByZero);
+      if (right == 0) return std::unexpected(Expr::Error::DivisionByZero);
       return left / right;
     case '%':
-      if (right == 0.0) return std::unexpected(Expr::Error::DivisionByZero);
+      if (right == 0) return std::unexpected(Expr::Error::DivisionByZero);
       return std::fmod(left, right);
     case '^':
       return std::pow(left, right);
+    case '<':
+      return static_cast<T>(left < right);
+    case 'l':
+      return static_cast<T>(left <= right);
+    case '>':
+      return static_cast<T>(left > right);
+    case 'g':
+      return static_cast<T>(left >= right);
+    case '=':
+      return static_cast<T>(left == right);
+    case '!':
+      return static_cast<T>(left != right);
     default:
       return std::unexpected(Expr::Error::InvalidOperator);
   }
 }
 
-Result Evaluator::visit(const Unary& unary) {
-  auto operand_result = evaluate(*unary.operand);
-  if (!operand_result) return operand_result;
-
-  double operand = *operand_result;
-
-  switch (unary.op) {
+template <typename T>
+auto BasicEvaluator<T>::apply(char op, T operand) -> Real {
+  switch (op) {
     case '-':
       return -operand;
     case '+':
@@ -72,3 +496,160 @@ Result Evaluator::visit(const Unary& unary) {
       return std::unexpected(Expr::Error::InvalidOperator);
   }
 }
+
+template <typename T>
+auto BasicEvaluator<T>::aggregate(const Aggregate& aggregate, T from, T to)
+    -> Real {
+  // Integer bounds, small enough that every index between them is exact
+  constexpr int digits = std::min(std::numeric_limits<T>::digits, 53) - 1;
+  auto valid = [](T bound) {
+    return std::trunc(bound) == bound &&
+           std::fabs(bound) <= static_cast<T>(std::uint64_t{1} << digits);
+  };
+  if (!valid(from) || !valid(to)) {
+    return std::unexpected(Expr::Error::InvalidRange);
+  }
+
+  Pairwise<T> combined(aggregate.op);
+  if (to < from) return combined.result();  // Empty range
+
+  auto count = static_cast<std::uint64_t>(to - from) + 1;
+  std::uint64_t chunks = (count - 1) / kChunk + 1;
+  std::vector<Real> partials;
+
+  for (std::uint64_t begin = 0; begin < chunks; begin += kRound) {
+    auto size = static_cast<size_t>(std::min(kRound, chunks - begin));
+    partials.assign(size, T(0));
+    // Chunks after a failed one are skipped; the earliest error is reported.
+    std::atomic<size_t> failed = size;
+
+    auto run = [&](BasicEvaluator& evaluator, size_t i) {
+      if (i > failed.load(std::memory_order_relaxed)) return;
+      std::uint64_t first = (begin + i) * kChunk;
+      partials[i] = evaluator.reduce(aggregate, from + static_cast<T>(first),
+                                     std::min(kChunk, count - first));
+      if (partials[i]) return;
+      size_t seen = failed.load();
+      while (i < seen && !failed.compare_exchange_weak(seen, i)) {
+      }
+    };
+
+    if (nested || size == 1) {
+      for (size_t i = 0; i < size; ++i) run(*this, i);
+    } else {
+      parallelFor(
+          size,
+          [&](size_t i) {
+            BasicEvaluator chunk_evaluator = helper();
+            run(chunk_evaluator, i);
+          },
+          threads);
+    }
+
+    for (const Real& partial : partials) {
+      if (!partial) return partial;
+      combined.push(*partial);
+    }
+  }
+
+  return combined.result();
+}
+
+// An evaluator for one chunk of a sum, on another thread. It sees the same
+// variables and indices but keeps its own state.
+template <typename T>
+auto BasicEvaluator<T>::helper() const -> BasicEvaluator {
+  BasicEvaluator helper;
+  helper.globals = globals;
+  helper.indices = indices;
+  helper.cancel_flag = cancel_flag;
+  helper.nested = true;
+  return helper;
+}
+
+// Terms a sum or product hands to a batch kernel at once
+static constexpr size_t kBatch = 256;
+
+// Folds count consecutive terms, in order, starting at index first. A body
+// that is a unary builtin with a batch kernel, e.g. sin(i / n), has its
+// argument evaluated for a block of indices and the kernel applied to the
+// whole block; only double has kernels.
+template <typename T>
+auto BasicEvaluator<T>::reduce(const Aggregate& aggregate, T first,
+                               std::uint64_t count) -> Real {
+  T result = aggregate.op == '+' ? T(0) : T(1);
+  auto fold = [&](T term) {
+    result = aggregate.op == '+' ? result + term : result * term;
+  };
+  indices.emplace_back(aggregate.index, first);
+
+  const Call* batched = nullptr;
+  if constexpr (std::is_same_v<T, double>) {
+    auto call = std::get_if<Call>(&aggregate.body->node);
+    if (call && call->function->batch && call->args.size() == 1) {
+      batched = call;
+    }
+  }
+
+  for (std::uint64_t i = 0; i < count;) {
+    if (!batched) {
+      indices.back().second = first + static_cast<T>(i++);
+      auto term = evaluateReal(*aggregate.body);
+      if (!term) {
+        indices.pop_back();
+        return term;
+      }
+      fold(*term);
+      continue;
+    }
+
+    // Separate buffers: kernels may read their input again after writing.
+    std::array<double, kBatch> in, out;
+    auto size = static_cast<size_t>(std::min<std::uint64_t>(kBatch, count - i));
+    for (size_t j = 0; j < size; ++j) {
+      indices.back().second = first + static_cast<T>(i + j);
+      auto arg = evaluateReal(*batched->args[0]);
+      if (!arg) {
+        indices.pop_back();
+        return arg;
+      }
+      in[j] = static_cast<double>(*arg);
+    }
+    batched->function->batch(std::span(in).first(size),
+                             std::span(out).first(size));
+    for (size_t j = 0; j < size; ++j) fold(static_cast<T>(out[j]));
+    i += size;
+  }
+
+  indices.pop_back();
+  return result;
+}
+
+template class BasicEvaluator<float>;
+template class BasicEvaluator<double>;
+template class BasicEvaluator<long double>;
+
+template <typename T>
+static std::expected<AnyValue, Expr::Error> evaluateIn(
+    const Expr& expr, const std::map<std::string, double>& variables,
+    const std::atomic<bool>* cancelled) {
+  BasicEvaluator<T> evaluator;
+  auto result = evaluator.evaluate(expr, variables, cancelled);
+  if (!result) return std::unexpected(result.error());
+  return std::visit([](auto value) -> AnyValue { return value; }, *result);
+}
+
+std::expected<AnyValue, Expr::Error> evaluateAs(
+    Precision precision, const Expr& expr,
+    const std::map<std::string, double>& variables,
+    const std::atomic<bool>* cancelled) {
+  switch (precision) {
+    case Precision::Float:
+      return evaluateIn<float>(expr, variables, cancelled);
+    case Precision::Double:
+      return evaluateIn<double>(expr, variables, cancelled);
+    case Precision::LongDouble:
+      return evaluateIn<long double>(expr, variables, cancelled);
+  }
+  return std::unexpected(Expr::Error::InvalidExpression);
+}
@@ -1,26 +1,103 @@
 #pragma once
 
+#include <atomic>
+#include <cstdint>
 #include <expected>
 #include <map>
+#include <optional>
 #include <string>
+#include <string_view>
+#include <utility>
+#include <variant>
+#include <vector>
 
 #include "parser.hh"
 
-class Evaluator {
+// Evaluates in the numeric type T: float, double or long double. Literals
+// and variables are rounded to T once, as they are read, and every operator
+// and builtin then runs in T.
+template <typename T>
+class BasicEvaluator {
  public:
-  std::map<std::string, double> variables;
-  using Result = std::expected<double, Expr::Error>;
+  // Integral subtrees produce an exact int64. A node whose exact result
+  // overflows or isn't an integer is computed in T instead, from its
+  // operands' exact values, and so is every node above it.
+  using Value = std::variant<std::int64_t, T>;
+  using Result = std::expected<Value, Expr::Error>;
+  using Real = std::expected<T, Expr::Error>;
 
-  Evaluator() = default;
+  // Sums and products spread over up to threads threads, or one per core
+  // when 0. Their results don't depend on the number.
+  explicit BasicEvaluator(size_t threads = 0) : threads(threads) {}
 
-  Result evaluate(const Expr& expr);
+  // Reads variables only from the given map, e.g. a VariableStore
+  // snapshot, which must stay unchanged until this returns. When given,
+  // cancelled is polled every few thousand nodes and evaluation stops with
+  // Error::Cancelled once it is set.
+  Result evaluate(const Expr& expr,
+                  const std::map<std::string, double>& variables,
+                  const std::atomic<bool>* cancelled = nullptr);
 
-  void setVariable(const std::string& name, double value);
-  void clearVariables();
+  // Operator semantics on already evaluated operands. Comparisons yield 1
+  // or 0; && and || need the operands unevaluated and aren't handled here.
+  static Real apply(char op, T left, T right);
+  static Real apply(char op, T operand);
 
  private:
-  Result visit(const Number& number);
-  Result visit(const Variable& variable);
-  Result visit(const Binary& binary);
-  Result visit(const Unary& unary);
+  const std::atomic<bool>* cancel_flag = nullptr;
+  bool stopped = false;  // Sticky once the flag has been seen set
+  size_t steps = 0;
+
+  // The caller's variables, shared with the helpers reducing chunks of a sum
+  const std::map<std::string, double>* globals = nullptr;
+  // Indices bound by the enclosing sums and products, innermost last
+  std::vector<std::pair<std::string_view, T>> indices;
+  bool nested = false;  // Reducing a chunk already; don't fan out again
+  size_t threads;
+
+  bool checkCancelled();
+  BasicEvaluator helper() const;
+  Real reduce(const Aggregate& aggregate, T first, std::uint64_t count);
+
+  // A node being evaluated, whose operands' values sit on the value stack
+  // from begin on
+  struct Frame {
+    const Expr* expr;
+    size_t next;  // Operands evaluated so far
+    size_t begin;
+  };
+  // Explicit stacks, reused between calls, so that the depth of an
+  // expression isn't limited by the thread's stack
+  std::vector<Frame> frames;
+  std::vector<T> values;
+  std::vector<Frame> integral_frames;
+  std::vector<Value> integral_values;
+
+  Real evaluateReal(const Expr& expr);
+  Real recurse(const Expr& expr);
+  std::optional<Expr::Error> enter(const Expr& expr);
+  Result evaluateIntegral(const Expr& expr);
+  Result recurseIntegral(const Expr& expr);
+
+  Real finish(const Expr& expr, size_t count, const T* operands);
+  Result finishIntegral(const Expr& expr, size_t count, const Value* operands);
+  Real lookup(const Variable& variable) const;
+  Real aggregate(const Aggregate& aggregate, T from, T to);
 };
+
+extern template class BasicEvaluator<float>;
+extern template class BasicEvaluator<double>;
+extern template class BasicEvaluator<long double>;
+
+using Evaluator = BasicEvaluator<double>;
+
+// Picks the instantiation at run time, once per expression: e.g. float for
+// throughput, long double to check a double result.
+enum class Precision { Float, Double, LongDouble };
+
+using AnyValue = std::variant<std::int64_t, float, double, long double>;
+
+std::expected<AnyValue, Expr::Error> evaluateAs(
+    Precision precision, const Expr& expr,
+    const std::map<std::string, double>& variables,
+    const std::atomic<bool>* cancelled = nullptr);
@@ -0,0 +1,79 @@
+#include "font.hh"
+
+#include <cstring>
+#include <iterator>
+
+#include "font_atlas.inc"  // Generated by tools/bake_font.cc
+
+// addFont and loadBakedFonts fill in ImFont and ImFontAtlas fields that
+// aren't public API and were reworked in 1.92. Check them against the new
+// headers before moving to another ImGui.
+static_assert(IMGUI_VERSION_NUM == 19140, "font.cc targets ImGui 1.91.4");
+
+// The font records point here instead of into the atlas' own ConfigData,
+// which the atlas would otherwise try to rebuild from TTF data we don't have.
+static ImFontConfig configs[std::size(baked::kFonts)];
+
+// PackBits: a header byte n < 128 copies the next n + 1 bytes, n >= 128
+// repeats the next byte n - 125 times.
+static void unpackBits(const unsigned char* in, std::size_t in_size,
+                       unsigned char* out) {
+  const unsigned char* end = in + in_size;
+  while (in < end) {
+    unsigned char header = *in++;
+    if (header < 128) {
+      std::memcpy(out, in, header + 1u);
+      in += header + 1u;
+      out += header + 1u;
+    } else {
+      std::memset(out, *in++, header - 125u);
+      out += header - 125u;
+    }
+  }
+}
+
+static ImFont* addFont(ImFontAtlas* atlas, const BakedFont& baked,
+                       ImFontConfig* config) {
+  config->SizePixels = baked.size;
+  config->FontDataOwnedByAtlas = false;
+
+  ImFont* font = IM_NEW(ImFont)();
+  font->FontSize = baked.size;
+  font->Ascent = baked.ascent;
+  font->Descent = baked.descent;
+  font->ContainerAtlas = atlas;
+  font->ConfigData = config;
+  font->ConfigDataCount = 1;
+  atlas->Fonts.push_back(font);
+
+  for (std::size_t i = 0; i < baked.glyph_count; ++i) {
+    const BakedGlyph& g = baked.glyphs[i];
+    font->AddGlyph(nullptr, g.codepoint, g.x0, g.y0, g.x1, g.y1, g.u0, g.v0,
+                   g.u1, g.v1, g.advance_x);
+  }
+  font->BuildLookupTable();
+  return font;
+}
+
+Fonts loadBakedFonts(ImFontAtlas* atlas) {
+  atlas->Clear();
+  // Lines and cursors were left out of the bake, don't expect them.
+  atlas->Flags |=
+      ImFontAtlasFlags_NoBakedLines | ImFontAtlasFlags_NoMouseCursors;
+
+  atlas->TexWidth = baked::kAtlasWidth;
+  atlas->TexHeight = baked::kAtlasHeight;
+  atlas->TexUvScale = ImVec2(1.0f / static_cast<float>(baked::kAtlasWidth),
+                             1.0f / static_cast<float>(baked::kAtlasHeight));
+  atlas->TexUvWhitePixel = ImVec2(baked::kWhiteU, baked::kWhiteV);
+  atlas->TexPixelsAlpha8 = static_cast<unsigned char*>(
+      IM_ALLOC(static_cast<std::size_t>(baked::kAtlasWidth) *
+               static_cast<std::size_t>(baked::kAtlasHeight)));
+  unpackBits(baked::kAtlasPixels, sizeof(baked::kAtlasPixels),
+             atlas->TexPixelsAlpha8);
+
+  ImFont* large = addFont(atlas, baked::kFonts[0], &configs[0]);
+  ImFont* button = addFont(atlas, baked::kFonts[1], &configs[1]);
+  atlas->TexReady = true;
+  return {large, button};
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <imgui.h>
+
+#include <cstddef>
+
+// Glyph and font records as written by tools/bake_font.cc. The atlas
+// pixels are stored PackBits-compressed (see unpackBits in font.cc).
+struct BakedGlyph {
+  ImWchar codepoint;
+  float advance_x;
+  float x0, y0, x1, y1;
+  float u0, v0, u1, v1;
+};
+
+struct BakedFont {
+  float size;
+  float ascent;
+  float descent;
+  const BakedGlyph* glyphs;
+  std::size_t glyph_count;
+};
+
+struct Fonts {
+  ImFont* large;
+  ImFont* button;
+};
+
+// Installs the atlas that was baked into the binary at build time. Nothing
+// is read from disk and nothing is rasterized.
+Fonts loadBakedFonts(ImFontAtlas* atlas);
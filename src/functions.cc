@@ -0,0 +1,54 @@
+#include "functions.hh"
+
+#include <algorithm>
+#include <cmath>
+
+#include "vmath.hh"
+
+// Instantiates f, a generic lambda over the argument span, for every
+// evaluation type.
+template <auto f>
+static constexpr std::tuple scalars = {
+    +[](std::span<const float> a) -> float { return f(a); },
+    +[](std::span<const double> a) -> double { return f(a); },
+    +[](std::span<const long double> a) -> long double { return f(a); }};
+
+static constexpr Function functions[] = {
+    {"abs", 1, 1, scalars<[](auto a) { return std::fabs(a[0]); }>, nullptr},
+    {"acos", 1, 1, scalars<[](auto a) { return std::acos(a[0]); }>, nullptr},
+    {"asin", 1, 1, scalars<[](auto a) { return std::asin(a[0]); }>, nullptr},
+    {"atan", 1, 1, scalars<[](auto a) { return std::atan(a[0]); }>, nullptr},
+    {"atan2", 2, 2,
+     scalars<[](auto a) { return std::atan2(a[0], a[1]); }>, nullptr},
+    {"cbrt", 1, 1, scalars<[](auto a) { return std::cbrt(a[0]); }>, nullptr},
+    {"ceil", 1, 1, scalars<[](auto a) { return std::ceil(a[0]); }>, nullptr},
+    {"cos", 1, 1, scalars<[](auto a) { return std::cos(a[0]); }>, vmath::cos},
+    {"cosh", 1, 1, scalars<[](auto a) { return std::cosh(a[0]); }>, nullptr},
+    {"exp", 1, 1, scalars<[](auto a) { return std::exp(a[0]); }>, vmath::exp},
+    {"floor", 1, 1, scalars<[](auto a) { return std::floor(a[0]); }>, nullptr},
+    {"hypot", 2, 2,
+     scalars<[](auto a) { return std::hypot(a[0], a[1]); }>, nullptr},
+    {"ln", 1, 1, scalars<[](auto a) { return std::log(a[0]); }>, vmath::log},
+    {"log", 1, 1, scalars<[](auto a) { return std::log(a[0]); }>, vmath::log},
+    {"log10", 1, 1, scalars<[](auto a) { return std::log10(a[0]); }>, nullptr},
+    {"log2", 1, 1, scalars<[](auto a) { return std::log2(a[0]); }>, nullptr},
+    {"max", 1, Function::kVariadic,
+     scalars<[](auto a) { return *std::ranges::max_element(a); }>, nullptr},
+    {"min", 1, Function::kVariadic,
+     scalars<[](auto a) { return *std::ranges::min_element(a); }>, nullptr},
+    {"pow", 2, 2,
+     scalars<[](auto a) { return std::pow(a[0], a[1]); }>, nullptr},
+    {"round", 1, 1, scalars<[](auto a) { return std::round(a[0]); }>, nullptr},
+    {"sin", 1, 1, scalars<[](auto a) { return std::sin(a[0]); }>, vmath::sin},
+    {"sinh", 1, 1, scalars<[](auto a) { return std::sinh(a[0]); }>, nullptr},
+    {"sqrt", 1, 1,
+     scalars<[](auto a) { return std::sqrt(a[0]); }>, vmath::sqrt},
+    {"tan", 1, 1, scalars<[](auto a) { return std::tan(a[0]); }>, nullptr},
+    {"tanh", 1, 1, scalars<[](auto a) { return std::tanh(a[0]); }>, nullptr},
+    {"trunc", 1, 1, scalars<[](auto a) { return std::trunc(a[0]); }>, nullptr},
+};
+
+const Function* findFunction(std::string_view name) {
+  auto it = std::ranges::find(functions, name, &Function::name);
+  return it == std::end(functions) ? nullptr : it;
+}
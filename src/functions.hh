@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstddef>
+#include <limits>
+#include <span>
+#include <string_view>
+#include <tuple>
+
+// A callable builtin. The parser resolves names to these entries once, so
+// evaluation calls straight through the pointers without any lookup.
+struct Function {
+  static constexpr std::size_t kVariadic =
+      std::numeric_limits<std::size_t>::max();
+
+  template <typename T>
+  using Scalar = T (*)(std::span<const T> args);
+
+  std::string_view name;
+  std::size_t min_arity;
+  std::size_t max_arity;
+  // The scalar form, once for each type an evaluator can run in
+  std::tuple<Scalar<float>, Scalar<double>, Scalar<long double>> scalars;
+  // Element-wise form for unary functions with a vectorized kernel, or
+  // nullptr when only the scalar form exists. Sums and products evaluated in
+  // double use it for a body that is a call to the function.
+  void (*batch)(std::span<const double> in, std::span<double> out);
+
+  template <typename T>
+  T apply(std::span<const T> args) const {
+    return std::get<Scalar<T>>(scalars)(args);
+  }
+
+  bool accepts(std::size_t count) const {
+    return count >= min_arity && count <= max_arity;
+  }
+};
+
+const Function* findFunction(std::string_view name);
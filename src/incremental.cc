@@ -0,0 +1,351 @@
+#include "incremental.hh"
+
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <span>
+
+using Result = Evaluator::Result;
+
+static double toDouble(const Evaluator::Value& value) {
+  return std::visit([](auto v) { return static_cast<double>(v); }, value);
+}
+
+static Result toResult(const Evaluator::Real& real) {
+  if (!real) return std::unexpected(real.error());
+  return *real;
+}
+
+// Bitwise, so that 0 and -0 differ and a NaN equals itself
+static bool sameValue(std::optional<double> a, std::optional<double> b) {
+  if (!a || !b) return !a && !b;
+  return std::bit_cast<std::uint64_t>(*a) == std::bit_cast<std::uint64_t>(*b);
+}
+
+// Operands in the order the evaluator visits them.
+static size_t operandCount(const Expr& expr) {
+  if (std::holds_alternative<Binary>(expr.node)) return 2;
+  if (std::holds_alternative<Unary>(expr.node)) return 1;
+  if (auto call = std::get_if<Call>(&expr.node)) return call->args.size();
+  if (std::holds_alternative<Logical>(expr.node)) return 2;
+  if (std::holds_alternative<Conditional>(expr.node)) return 3;
+  return 0;
+}
+
+static const Expr& operand(const Expr& expr, size_t i) {
+  if (auto binary = std::get_if<Binary>(&expr.node)) {
+    return i == 0 ? *binary->left : *binary->right;
+  }
+  if (auto unary = std::get_if<Unary>(&expr.node)) return *unary->operand;
+  if (auto logical = std::get_if<Logical>(&expr.node)) {
+    return i == 0 ? *logical->left : *logical->right;
+  }
+  if (auto conditional = std::get_if<Conditional>(&expr.node)) {
+    return i == 0 ? *conditional->condition
+                  : i == 1 ? *conditional->then : *conditional->otherwise;
+  }
+  return *std::get<Call>(expr.node).args[i];
+}
+
+// Recomputed whole by the evaluator rather than from cached operands: sums
+// and products bind indices.
+static bool isLeaf(const Expr& expr) {
+  return std::holds_alternative<Aggregate>(expr.node);
+}
+
+// &&, || and conditionals evaluate only some of their operands.
+static bool isLazy(const Expr& expr) {
+  return std::holds_alternative<Logical>(expr.node) ||
+         std::holds_alternative<Conditional>(expr.node);
+}
+
+// Appends the variables expr reads from outside, skipping the indices bound
+// by sums and products within it. Walks with an explicit stack, like
+// flatten.
+static void collectFree(const Expr& expr, std::vector<std::string_view>& free) {
+  enum class Step { Visit, Bind, Unbind };
+  // Pending work, last first; Bind and Unbind open and close the scope of
+  // an aggregate's index
+  std::vector<std::pair<const Expr*, Step>> pending = {{&expr, Step::Visit}};
+  std::vector<std::string_view> bound;
+
+  while (!pending.empty()) {
+    auto [current, step] = pending.back();
+    pending.pop_back();
+
+    if (step == Step::Bind) {
+      bound.push_back(std::get<Aggregate>(current->node).index);
+      continue;
+    }
+    if (step == Step::Unbind) {
+      bound.pop_back();
+      continue;
+    }
+
+    if (auto variable = std::get_if<Variable>(&current->node)) {
+      std::string_view name = variable->name;
+      if (std::ranges::find(bound, name) == bound.end() &&
+          std::ranges::find(free, name) == free.end()) {
+        free.push_back(name);
+      }
+      continue;
+    }
+
+    if (auto aggregate = std::get_if<Aggregate>(&current->node)) {
+      pending.push_back({current, Step::Unbind});
+      pending.push_back({aggregate->body.get(), Step::Visit});
+      pending.push_back({current, Step::Bind});
+      pending.push_back({aggregate->to.get(), Step::Visit});
+      pending.push_back({aggregate->from.get(), Step::Visit});
+      continue;
+    }
+
+    for (size_t i = operandCount(*current); i-- > 0;) {
+      pending.push_back({&operand(*current, i), Step::Visit});
+    }
+  }
+}
+
+Incremental::Incremental(const Expr& expr,
+                         const std::atomic<bool>* cancelled) {
+  std::map<std::string_view, size_t> slot_ids;
+  auto top = flatten(expr, slot_ids, cancelled);
+  root = top ? *top : addConstant(expr, cancelled);
+}
+
+// Post-order walk with an explicit stack: pasted expressions can be deep
+// enough to overflow the call stack.
+std::optional<size_t> Incremental::flatten(
+    const Expr& expr, std::map<std::string_view, size_t>& slot_ids,
+    const std::atomic<bool>* cancelled) {
+  struct Frame {
+    const Expr* expr;
+    size_t next;           // Next operand to descend into
+    size_t results_begin;  // Where this node's operand results start
+  };
+  std::vector<Frame> stack = {{&expr, 0, 0}};
+  // Node per finished subtree, nullopt for those without variables
+  std::vector<std::optional<size_t>> results;
+  size_t steps = 0;  // Loop iterations, to pace cancellation checks
+
+  while (!stack.empty()) {
+    // What a cancelled build leaves only reports that it was cancelled.
+    if (cancelled && (++steps & 0xfff) == 0 &&
+        cancelled->load(std::memory_order_relaxed)) {
+      nodes.assign(1, Node{.expr = nullptr,
+                           .value = std::unexpected(Expr::Error::Cancelled)});
+      children.clear();
+      slots.clear();
+      return 0;
+    }
+
+    Frame& frame = stack.back();
+    const Expr& current = *frame.expr;
+
+    auto slotFor = [&](std::string_view name) {
+      auto [it, inserted] = slot_ids.try_emplace(name, slots.size());
+      if (inserted) slots.push_back(Slot{std::string(name), std::nullopt, {}});
+      return it->second;
+    };
+
+    if (auto variable = std::get_if<Variable>(&current.node)) {
+      size_t slot = slotFor(variable->name);
+      size_t id = nodes.size();
+      nodes.push_back(Node{.expr = &current, .slot = slot, .dirty = true});
+      slots[slot].occurrences.push_back(id);
+      stack.pop_back();
+      results.push_back(id);
+      continue;
+    }
+
+    // See isLeaf: these are recomputed whole whenever any variable they
+    // read changes.
+    if (isLeaf(current)) {
+      std::vector<std::string_view> reads;
+      collectFree(current, reads);
+      std::optional<size_t> id;
+      if (!reads.empty()) {
+        id = nodes.size();
+        nodes.push_back(Node{.expr = &current, .dirty = true});
+        for (std::string_view name : reads) {
+          slots[slotFor(name)].occurrences.push_back(*id);
+        }
+      }
+      stack.pop_back();
+      results.push_back(id);
+      continue;
+    }
+
+    size_t count = operandCount(current);
+    if (frame.next < count) {
+      const Expr& next = operand(current, frame.next++);
+      stack.push_back({&next, 0, results.size()});
+      continue;
+    }
+
+    auto operands = std::span(results).subspan(frame.results_begin);
+    bool reads_variables = std::ranges::any_of(
+        operands, [](const auto& result) { return result.has_value(); });
+    std::optional<size_t> id;
+
+    if (reads_variables) {
+      // Only now is it known that constant operands need nodes of their own.
+      // Those of &&, || and conditionals are folded once first needed, like
+      // leaves without variables, since they may never be.
+      size_t first_child = children.size();
+      for (size_t i = 0; i < count; ++i) {
+        const Expr& constant = operand(current, i);
+        if (operands[i]) {
+          children.push_back(*operands[i]);
+        } else if (isLazy(current)) {
+          children.push_back(nodes.size());
+          nodes.push_back(Node{.expr = &constant, .dirty = true});
+        } else {
+          children.push_back(addConstant(constant, cancelled));
+        }
+      }
+
+      id = nodes.size();
+      nodes.push_back(Node{.expr = &current,
+                           .first_child = first_child,
+                           .child_count = count,
+                           .dirty = true});
+      for (size_t i = 0; i < count; ++i) {
+        nodes[children[first_child + i]].parent = *id;
+      }
+    }
+
+    results.resize(frame.results_begin);
+    stack.pop_back();
+    results.push_back(id);
+  }
+
+  return results.front();
+}
+
+size_t Incremental::addConstant(const Expr& expr,
+                                const std::atomic<bool>* cancelled) {
+  nodes.push_back(
+      Node{.expr = nullptr, .value = folder.evaluate(expr, {}, cancelled)});
+  return nodes.size() - 1;
+}
+
+Result Incremental::evaluate(const std::map<std::string, double>& variables,
+                             const std::atomic<bool>* cancelled) {
+  for (Slot& slot : slots) {
+    auto it = variables.find(slot.name);
+    std::optional<double> value;
+    if (it != variables.end()) value = it->second;
+    if (sameValue(value, slot.value)) continue;
+
+    slot.value = value;
+    for (size_t leaf : slot.occurrences) markDirty(leaf);
+  }
+
+  // Brings what the root needs up to date, children first; see neededChild.
+  stack.clear();
+  if (nodes[root].dirty) stack.push_back({root, 0});
+  size_t steps = 0;
+  while (!stack.empty()) {
+    auto& [id, next] = stack.back();
+    Node& node = nodes[id];
+
+    size_t child = neededChild(node, next);
+    if (child != kNone) {
+      next++;
+      if (nodes[child].dirty) stack.push_back({child, 0});
+      continue;
+    }
+
+    // Whatever is left stays dirty, and so do its ancestors.
+    if (cancelled && (++steps & 0xfff) == 0 &&
+        cancelled->load(std::memory_order_relaxed)) {
+      return std::unexpected(Expr::Error::Cancelled);
+    }
+    recompute(node, variables, cancelled);
+    // A leaf evaluated whole notices cancellation by itself.
+    if (!node.value && node.value.error() == Expr::Error::Cancelled) {
+      return std::unexpected(Expr::Error::Cancelled);
+    }
+    node.dirty = false;
+    stack.pop_back();
+  }
+
+  return nodes[root].value;
+}
+
+// Marking stops at a node that is dirty already: either its parent is too,
+// or the parent's value doesn't depend on it.
+void Incremental::markDirty(size_t node) {
+  while (node != kNone && !nodes[node].dirty) {
+    nodes[node].dirty = true;
+    node = nodes[node].parent;
+  }
+}
+
+// Like the evaluator, an error stops at the operand that raised it, && and
+// || skip the right operand when the left decides, and a conditional skips
+// the branch not taken. A child skipped this way may stay dirty.
+size_t Incremental::neededChild(const Node& node, size_t next) const {
+  if (next == node.child_count) return kNone;
+  const size_t* operands = children.data() + node.first_child;
+  if (next == 0) return operands[0];
+
+  const Result& last = nodes[operands[next - 1]].value;
+  if (!last) return kNone;
+  if (auto logical = std::get_if<Logical>(&node.expr->node)) {
+    bool decided = (toDouble(*last) != 0) == (logical->op == '|');
+    return decided ? kNone : operands[1];
+  }
+  if (std::holds_alternative<Conditional>(node.expr->node)) {
+    if (next == 2) return kNone;
+    return toDouble(*last) != 0 ? operands[1] : operands[2];
+  }
+  return operands[next];
+}
+
+void Incremental::recompute(Node& node,
+                            const std::map<std::string, double>& variables,
+                            const std::atomic<bool>* cancelled) {
+  const Expr& expr = *node.expr;
+
+  if (std::holds_alternative<Variable>(expr.node)) {
+    const auto& value = slots[node.slot].value;
+    if (value) {
+      node.value = *value;
+    } else {
+      node.value = std::unexpected(Expr::Error::UndefinedVariable);
+    }
+    return;
+  }
+
+  // Sums and products, and constants folded on first use
+  if (node.child_count == 0) {
+    node.value = folder.evaluate(expr, variables, cancelled);
+    return;
+  }
+
+  // The operands neededChild asked for, as doubles
+  args.clear();
+  for (size_t i = 0, child; (child = neededChild(node, i)) != kNone; ++i) {
+    const Result& value = nodes[child].value;
+    if (!value) {
+      node.value = value;
+      return;
+    }
+    args.push_back(toDouble(*value));
+  }
+
+  if (auto binary = std::get_if<Binary>(&expr.node)) {
+    node.value = toResult(Evaluator::apply(binary->op, args[0], args[1]));
+  } else if (auto unary = std::get_if<Unary>(&expr.node)) {
+    node.value = toResult(Evaluator::apply(unary->op, args[0]));
+  } else if (auto call = std::get_if<Call>(&expr.node)) {
+    node.value = call->function->apply<double>(args);
+  } else if (std::holds_alternative<Logical>(expr.node)) {
+    // Any nonzero value, NaN included, counts as true.
+    node.value = static_cast<double>(args.back() != 0);
+  } else {
+    node.value = args.back();  // Conditional: the taken branch
+  }
+}
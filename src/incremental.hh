@@ -0,0 +1,74 @@
+#pragma once
+
+#include <atomic>
+#include <map>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "evaluator.hh"
+#include "parser.hh"
+
+// Re-evaluates one expression as its variables change. The tree is
+// flattened into nodes that cache their last result, and every variable
+// keeps the list of leaves that read it. Changing a variable marks the paths
+// from those leaves to the root, and only marked nodes the result needs are
+// recomputed: &&, || and conditionals skip operands they don't evaluate,
+// which stay marked until needed. Subtrees without variables are folded into
+// constants; sums and products are single leaves.
+//
+// Results match Evaluator::evaluate on the same tree and variables.
+class Incremental {
+ public:
+  // The expression must outlive this object. Building stops once cancelled
+  // is set, and the object then only returns Error::Cancelled.
+  explicit Incremental(const Expr& expr,
+                       const std::atomic<bool>* cancelled = nullptr);
+
+  // Stops with Error::Cancelled once cancelled is set; the next call picks
+  // up the remaining work.
+  Evaluator::Result evaluate(const std::map<std::string, double>& variables,
+                             const std::atomic<bool>* cancelled = nullptr);
+
+ private:
+  static constexpr size_t kNone = static_cast<size_t>(-1);
+
+  struct Node {
+    const Expr* expr;  // nullptr for folded constants
+    size_t parent = kNone;
+    size_t first_child = 0;  // Into children
+    size_t child_count = 0;
+    size_t slot = kNone;  // For variable leaves
+    bool dirty = false;
+    Evaluator::Result value;
+  };
+
+  struct Slot {
+    std::string name;
+    std::optional<double> value;
+    std::vector<size_t> occurrences;  // Leaves reading this slot
+  };
+
+  std::vector<Node> nodes;  // Children always precede their parent
+  std::vector<size_t> children;
+  std::vector<Slot> slots;
+  // Nodes being brought up to date, with the number of children done;
+  // reused between calls
+  std::vector<std::pair<size_t, size_t>> stack;
+  std::vector<double> args;  // Operand scratch for recompute
+  size_t root;
+
+  Evaluator folder;  // For constant subtrees, and for sums and products
+
+  // Returns the node for expr, or nullopt when it reads no variables and the
+  // caller should fold it
+  std::optional<size_t> flatten(const Expr& expr,
+                                std::map<std::string_view, size_t>& slot_ids,
+                                const std::atomic<bool>* cancelled);
+  size_t addConstant(const Expr& expr, const std::atomic<bool>* cancelled);
+  void markDirty(size_t node);
+  size_t neededChild(const Node& node, size_t next) const;
+  void recompute(Node& node, const std::map<std::string, double>& variables,
+                 const std::atomic<bool>* cancelled);
+};
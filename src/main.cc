@@ -1,9 +1,17 @@
 #include "app.cc"
+#include "editor.cc"
 #include "evaluator.cc"
+#include "font.cc"
+#include "functions.cc"
+#include "incremental.cc"
 #include "parser.cc"
 #include "printer.cc"
 #include "stack.cc"
+#include "state.cc"
 #include "ui.cc"
+#include "variables.cc"
+#include "vmath.cc"
+#include "worker.cc"
 
 int main() {
   App app;
@@ -1,34 +1,139 @@
 #include "parser.hh"
 
+#include <algorithm>
 #include <cctype>
+#include <charconv>
+#include <cstdlib>
 #include <map>
 #include <optional>
 #include <string>
+#include <utility>
+#include <vector>
 
 #include "stack.hh"
 
+// Operators as written, longest first, and the char each is stored as
+static constexpr std::pair<std::string_view, char> spellings[] = {
+    {"<=", 'l'}, {">=", 'g'}, {"==", '='}, {"!=", '!'}, {"&&", '&'},
+    {"||", '|'}, {"<", '<'},  {">", '>'},  {"+", '+'},  {"-", '-'},
+    {"*", '*'},  {"/", '/'},  {"%", '%'},  {"^", '^'},  {"?", '?'},
+    {":", ':'}};
+
+// ':' stands for a conditional whose '?' has been matched
 static const std::map<char, int> precedence = {
-    {'+', 1}, {'-', 1}, {'*', 2}, {'/', 2}, {'%', 2}, {'^', 3}, {'(', 0}};
+    {'?', 1}, {':', 1}, {'|', 2}, {'&', 3}, {'=', 4}, {'!', 4},
+    {'<', 5}, {'l', 5}, {'>', 5}, {'g', 5}, {'+', 6}, {'-', 6},
+    {'*', 7}, {'/', 7}, {'%', 7}, {'^', 8}, {'(', 0}};
+
+// Forms that bind an index variable: sum(i, from, to, body) and prod(...)
+static const std::map<std::string_view, char> aggregates = {{"sum", '+'},
+                                                             {"prod", '*'}};
+// Evaluating a sum inside a sum recurses, so their nesting is bounded.
+static constexpr size_t kMaxAggregateNesting = 64;
 
 static int getPrecedence(const Operator& op) {
   if (op.isUnary) {
-    return 4;  // Higher than any binary operator
+    return 9;  // Higher than any binary operator
   }
 
   return precedence.at(op.op);
 }
 
 static bool isLeftAssociative(char op) {
-  return op == '+' || op == '-' || op == '*' || op == '/' || op == '%';
+  return op != '^' && op != '?' && op != ':';
+}
+
+// The operator written at infix[i], if any, and the length of its spelling
+static std::optional<std::pair<char, size_t>> matchOperator(
+    std::string_view infix, size_t i) {
+  for (auto [spelling, op] : spellings) {
+    if (infix.substr(i).starts_with(spelling)) {
+      return std::pair(op, spelling.size());
+    }
+  }
+  return std::nullopt;
+}
+
+std::string_view operatorSpelling(char op) {
+  for (auto [spelling, stored] : spellings) {
+    if (stored == op) return spelling;
+  }
+  return {};
 }
 
 Variable::Variable(std::string name) : name(std::move(name)) {}
 Binary::Binary(char op, ExprPtr left, ExprPtr right)
     : op(op), left(std::move(left)), right(std::move(right)) {}
 Unary::Unary(char op, ExprPtr operand) : op(op), operand(std::move(operand)) {}
+Call::Call(const Function* function, std::vector<ExprPtr> args)
+    : function(function), args(std::move(args)) {}
+Aggregate::Aggregate(char op, std::string index, ExprPtr from, ExprPtr to,
+                     ExprPtr body)
+    : op(op),
+      index(std::move(index)),
+      from(std::move(from)),
+      to(std::move(to)),
+      body(std::move(body)) {}
+Logical::Logical(char op, ExprPtr left, ExprPtr right)
+    : op(op), left(std::move(left)), right(std::move(right)) {}
+Conditional::Conditional(ExprPtr condition, ExprPtr then, ExprPtr otherwise)
+    : condition(std::move(condition)),
+      then(std::move(then)),
+      otherwise(std::move(otherwise)) {}
+
+// Moves the children of expr to the end of into.
+static void detachChildren(Expr& expr, std::vector<ExprPtr>& into) {
+  auto detach = [&](ExprPtr& child) {
+    if (child) into.push_back(std::move(child));
+  };
+  if (auto binary = std::get_if<Binary>(&expr.node)) {
+    detach(binary->left);
+    detach(binary->right);
+  } else if (auto unary = std::get_if<Unary>(&expr.node)) {
+    detach(unary->operand);
+  } else if (auto call = std::get_if<Call>(&expr.node)) {
+    for (ExprPtr& arg : call->args) detach(arg);
+  } else if (auto aggregate = std::get_if<Aggregate>(&expr.node)) {
+    detach(aggregate->from);
+    detach(aggregate->to);
+    detach(aggregate->body);
+  } else if (auto logical = std::get_if<Logical>(&expr.node)) {
+    detach(logical->left);
+    detach(logical->right);
+  } else if (auto conditional = std::get_if<Conditional>(&expr.node)) {
+    detach(conditional->condition);
+    detach(conditional->then);
+    detach(conditional->otherwise);
+  }
+}
+
+// Freeing child by child would recurse once per level, and a pasted
+// expression can be deeper than the stack. Descendants are detached onto a
+// list instead, so each is freed with no children left.
+Expr::~Expr() {
+  std::vector<ExprPtr> pending;
+  detachChildren(*this, pending);
+  while (!pending.empty()) {
+    ExprPtr expr = std::move(pending.back());
+    pending.pop_back();
+    detachChildren(*expr, pending);
+  }
+}
 
 ExprPtr Expr::makeNumber(double value) {
-  return std::make_unique<Expr>(Number{value});
+  return std::make_unique<Expr>(Number{value, std::nullopt});
+}
+
+ExprPtr Expr::makeNumber(Number number) {
+  return std::make_unique<Expr>(std::move(number));
+}
+
+ExprPtr Expr::makeInteger(std::int64_t value) {
+  auto expr = std::make_unique<Expr>(
+      Number{static_cast<double>(value), value, static_cast<float>(value),
+             static_cast<long double>(value)});
+  expr->integral = true;
+  return expr;
 }
 
 ExprPtr Expr::makeVariable(std::string name) {
@@ -36,11 +141,62 @@ ExprPtr Expr::makeVariable(std::string name) {
 }
 
 ExprPtr Expr::makeBinary(char op, ExprPtr left, ExprPtr right) {
-  return std::make_unique<Expr>(Binary{op, std::move(left), std::move(right)});
+  bool integral = left->integral && right->integral;
+  size_t height = std::max(left->height, right->height) + 1;
+  auto expr =
+      std::make_unique<Expr>(Binary{op, std::move(left), std::move(right)});
+  expr->integral = integral;
+  expr->height = height;
+  return expr;
 }
 
 ExprPtr Expr::makeUnary(char op, ExprPtr operand) {
-  return std::make_unique<Expr>(Unary{op, std::move(operand)});
+  bool integral = operand->integral;
+  size_t height = operand->height + 1;
+  auto expr = std::make_unique<Expr>(Unary{op, std::move(operand)});
+  expr->integral = integral;
+  expr->height = height;
+  return expr;
+}
+
+ExprPtr Expr::makeCall(const Function* function, std::vector<ExprPtr> args) {
+  size_t height = 1;
+  for (const auto& arg : args) height = std::max(height, arg->height + 1);
+  auto expr = std::make_unique<Expr>(Call{function, std::move(args)});
+  expr->height = height;
+  return expr;
+}
+
+ExprPtr Expr::makeAggregate(char op, std::string index, ExprPtr from,
+                            ExprPtr to, ExprPtr body) {
+  size_t height = std::max({from->height, to->height, body->height}) + 1;
+  auto expr = std::make_unique<Expr>(Aggregate{
+      op, std::move(index), std::move(from), std::move(to), std::move(body)});
+  expr->height = height;
+  return expr;
+}
+
+ExprPtr Expr::makeLogical(char op, ExprPtr left, ExprPtr right) {
+  bool integral = left->integral && right->integral;
+  size_t height = std::max(left->height, right->height) + 1;
+  auto expr =
+      std::make_unique<Expr>(Logical{op, std::move(left), std::move(right)});
+  expr->integral = integral;
+  expr->height = height;
+  return expr;
+}
+
+ExprPtr Expr::makeConditional(ExprPtr condition, ExprPtr then,
+                              ExprPtr otherwise) {
+  bool integral =
+      condition->integral && then->integral && otherwise->integral;
+  size_t height =
+      std::max({condition->height, then->height, otherwise->height}) + 1;
+  auto expr = std::make_unique<Expr>(Conditional{
+      std::move(condition), std::move(then), std::move(otherwise)});
+  expr->integral = integral;
+  expr->height = height;
+  return expr;
 }
 
 static std::expected<ExprPtr, Expr::Error> parseToken(std::string_view& input,
@@ -57,6 +213,15 @@ static std::expected<ExprPtr, Expr::Error> parseToken(std::string_view& input,
     while (i < input.length() && (std::isdigit(input[i]) || input[i] == '.')) {
       token += input[i++];
     }
+    // Integer literals keep their exact value when it fits in int64
+    if (token.find('.') == std::string::npos) {
+      std::int64_t value;
+      auto [end, ec] =
+          std::from_chars(token.data(), token.data() + token.size(), value);
+      if (ec == std::errc() && end == token.data() + token.size()) {
+        return Expr::makeInteger(value);
+      }
+    }
     try {
       size_t pos;
       double value = std::stod(token, &pos);
@@ -64,7 +229,10 @@ static std::expected<ExprPtr, Expr::Error> parseToken(std::string_view& input,
       if (pos != token.length()) {
         return std::unexpected(Expr::Error::InvalidExpression);
       }
-      return Expr::makeNumber(value);
+      // Rounded separately for each evaluation type
+      return Expr::makeNumber(Number{value, std::nullopt,
+                                     std::strtof(token.c_str(), nullptr),
+                                     std::strtold(token.c_str(), nullptr)});
     } catch (...) {
       return std::unexpected(Expr::Error::InvalidExpression);
     }
@@ -82,11 +250,14 @@ static std::expected<ExprPtr, Expr::Error> parseToken(std::string_view& input,
 }
 
 // NOTE: Shunting Yard Algorithm
-std::expected<ExprPtr, Expr::Error> parseString(std::string_view infix) {
+std::expected<ExprPtr, Expr::Error> parseString(
+    std::string_view infix, const std::atomic<bool>* cancelled) {
   Stack<ExprPtr> expr_stack;  // Stack for expressions
   Stack<Operator> op_stack;   // Stack for operators
   size_t i = 0;
   bool expect_operand = true;  // Tracks whether we expect an operand next
+  size_t open_aggregates = 0;  // sum( and prod( not yet closed
+  size_t steps = 0;            // Loop iterations, to pace cancellation checks
 
   // Helper function to apply an operator from the stack
   auto applyOperator = [&]() -> std::expected<void, Expr::Error> {
@@ -94,7 +265,17 @@ std::expected<ExprPtr, Expr::Error> parseString(std::string_view infix) {
       return std::unexpected(Expr::Error::InvalidExpression);
 
     Operator op = op_stack.pop().value();
-    if (op.isUnary) {
+    if (op.op == '?') {
+      return std::unexpected(Expr::Error::InvalidExpression);  // No ':'
+    } else if (op.op == ':') {
+      if (expr_stack.size() < 3)
+        return std::unexpected(Expr::Error::InvalidExpression);
+      auto otherwise = std::move(expr_stack.pop().value());
+      auto then = std::move(expr_stack.pop().value());
+      auto condition = std::move(expr_stack.pop().value());
+      expr_stack.push(Expr::makeConditional(
+          std::move(condition), std::move(then), std::move(otherwise)));
+    } else if (op.isUnary) {
       if (expr_stack.size() < 1)
         return std::unexpected(Expr::Error::InvalidExpression);
       auto operand = std::move(expr_stack.pop().value());
@@ -104,13 +285,23 @@ std::expected<ExprPtr, Expr::Error> parseString(std::string_view infix) {
         return std::unexpected(Expr::Error::InvalidExpression);
       auto right = std::move(expr_stack.pop().value());
       auto left = std::move(expr_stack.pop().value());
-      expr_stack.push(
-          Expr::makeBinary(op.op, std::move(left), std::move(right)));
+      if (op.op == '&' || op.op == '|') {
+        expr_stack.push(
+            Expr::makeLogical(op.op, std::move(left), std::move(right)));
+      } else {
+        expr_stack.push(
+            Expr::makeBinary(op.op, std::move(left), std::move(right)));
+      }
     }
     return {};
   };
 
   while (i < infix.length()) {
+    if (cancelled && (++steps & 0xfff) == 0 &&
+        cancelled->load(std::memory_order_relaxed)) {
+      return std::unexpected(Expr::Error::Cancelled);
+    }
+
     char c = infix[i];
 
     // Skip whitespace
@@ -135,19 +326,90 @@ std::expected<ExprPtr, Expr::Error> parseString(std::string_view infix) {
       if (op_stack.isEmpty()) {
         return std::unexpected(Expr::Error::UnbalancedParentheses);
       }
-      op_stack.pop();          // Remove '('
+      Operator paren = op_stack.pop().value();  // Remove '('
+      if (paren.aggregate) open_aggregates--;
+      if (paren.function || paren.aggregate) {
+        // The last argument ends here, unless the call is empty: "f()"
+        if (!expect_operand) {
+          paren.argc++;
+        } else if (paren.argc != 0) {
+          return std::unexpected(Expr::Error::InvalidExpression);
+        }
+        if (paren.function ? !paren.function->accepts(paren.argc)
+                           : paren.argc != 4) {
+          return std::unexpected(Expr::Error::ArityMismatch);
+        }
+        if (expr_stack.size() < paren.argc) {
+          return std::unexpected(Expr::Error::InvalidExpression);
+        }
+        std::vector<ExprPtr> args(paren.argc);
+        for (size_t arg = paren.argc; arg-- > 0;) {
+          args[arg] = std::move(expr_stack.pop().value());
+        }
+        if (paren.function) {
+          expr_stack.push(Expr::makeCall(paren.function, std::move(args)));
+        } else {
+          // The index has to be a plain name
+          auto index = std::get_if<Variable>(&args[0]->node);
+          if (!index) return std::unexpected(Expr::Error::InvalidExpression);
+          expr_stack.push(Expr::makeAggregate(
+              paren.aggregate, std::move(index->name), std::move(args[1]),
+              std::move(args[2]), std::move(args[3])));
+        }
+      }
       expect_operand = false;  // After ')', expect an operator or end
       i++;
     }
+    // Handle argument separators
+    else if (c == ',') {
+      if (expect_operand) {
+        return std::unexpected(Expr::Error::InvalidExpression);
+      }
+      while (!op_stack.isEmpty() && op_stack.top().value().op != '(') {
+        if (auto result = applyOperator(); !result) {
+          return std::unexpected(result.error());
+        }
+      }
+      if (op_stack.isEmpty() || (!op_stack.top().value().function &&
+                                 !op_stack.top().value().aggregate)) {
+        return std::unexpected(Expr::Error::InvalidExpression);
+      }
+      Operator paren = op_stack.pop().value();
+      paren.argc++;
+      op_stack.push(paren);
+      expect_operand = true;  // After ',', expect the next argument
+      i++;
+    }
+    // Handle the ':' of a conditional: finish its middle operand and turn
+    // the '?' into the operator that builds it
+    else if (c == ':') {
+      if (expect_operand) {
+        return std::unexpected(Expr::Error::InvalidExpression);
+      }
+      while (!op_stack.isEmpty() && op_stack.top().value().op != '(' &&
+             op_stack.top().value().op != '?') {
+        if (auto result = applyOperator(); !result) {
+          return std::unexpected(result.error());
+        }
+      }
+      if (op_stack.isEmpty() || op_stack.top().value().op != '?') {
+        return std::unexpected(Expr::Error::InvalidExpression);
+      }
+      op_stack.pop();
+      op_stack.push(Operator{':', false});
+      expect_operand = true;  // After ':', expect the last operand
+      i++;
+    }
     // Handle operators
-    else if (precedence.contains(c)) {  // Check if it's a valid operator
-      if (expect_operand && (c == '-' || c == '+')) {
+    else if (auto match = matchOperator(infix, i)) {
+      auto [op, length] = *match;
+      if (expect_operand && (op == '-' || op == '+')) {
         // Treat as unary operator
-        op_stack.push(Operator{c, true});
+        op_stack.push(Operator{op, true});
         expect_operand = true;  // Still expect an operand after unary operator
       } else {
         // Treat as binary operator
-        Operator currOp = {c, false};
+        Operator currOp = {op, false};
         while (!op_stack.isEmpty() && op_stack.top().value().op != '(') {
           Operator topOp = op_stack.top().value();
           // Apply operators with higher precedence or equal precedence if
@@ -165,13 +427,38 @@ std::expected<ExprPtr, Expr::Error> parseString(std::string_view infix) {
         op_stack.push(currOp);
         expect_operand = true;  // After binary operator, expect an operand
       }
-      i++;
+      i += length;
     }
     // Handle numbers and variables
     else {
       if (!expect_operand) {
         return std::unexpected(Expr::Error::InvalidExpression);
       }
+      // A name directly followed by '(' is a call, resolved here once
+      if (std::isalpha(c)) {
+        size_t end = i;
+        while (end < infix.length() && std::isalnum(infix[end])) end++;
+        size_t next = end;
+        while (next < infix.length() && std::isspace(infix[next])) next++;
+        if (next < infix.length() && infix[next] == '(') {
+          std::string_view name = infix.substr(i, end - i);
+          const Function* function = findFunction(name);
+          auto aggregate = aggregates.find(name);
+          if (!function && aggregate == aggregates.end()) {
+            return std::unexpected(Expr::Error::UnknownFunction);
+          }
+          if (aggregate != aggregates.end() &&
+              ++open_aggregates > kMaxAggregateNesting) {
+            return std::unexpected(Expr::Error::NestingTooDeep);
+          }
+          op_stack.push(Operator{
+              '(', false, function, 0,
+              aggregate == aggregates.end() ? '\0' : aggregate->second});
+          expect_operand = true;  // After '(', expect an argument
+          i = next + 1;
+          continue;
+        }
+      }
       auto tokenResult = parseToken(infix, i);
       if (!tokenResult) {
         return std::unexpected(tokenResult.error());
@@ -213,6 +500,16 @@ constexpr const std::string_view errorToString(Expr::Error error) {
       return "Unknown Variable";
     case EError::DivisionByZero:
       return "Division by Zero";
+    case EError::UnknownFunction:
+      return "Unknown Function";
+    case EError::ArityMismatch:
+      return "Wrong Arg Count";
+    case EError::InvalidRange:
+      return "Invalid Range";
+    case EError::NestingTooDeep:
+      return "Nested Too Deep";
+    case EError::Cancelled:
+      return "Cancelled";
   }
 }
 
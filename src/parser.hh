@@ -1,10 +1,17 @@
 #pragma once
 
+#include <atomic>
+#include <cstdint>
 #include <expected>
 #include <memory>
+#include <optional>
 #include <string>
 #include <string_view>
+#include <type_traits>
 #include <variant>
+#include <vector>
+
+#include "functions.hh"
 
 struct Expr;
 
@@ -13,10 +20,30 @@ using ExprPtr = std::unique_ptr<Expr>;
 struct Operator {
   char op;
   bool isUnary;
+  // Set on the '(' that opens a call, together with the arguments seen so far
+  const Function* function = nullptr;
+  size_t argc = 0;
+  char aggregate = 0;  // Set instead of function for sum( and prod(
 };
 
 struct Number {
   double value;
+  std::optional<std::int64_t> exact;  // Set for integer literals
+  // The literal rounded straight to the other evaluation types; rounding
+  // through double would lose the extra digits of long double
+  float float_value = static_cast<float>(value);
+  long double long_double_value = value;
+
+  template <typename T>
+  T as() const {
+    if constexpr (std::is_same_v<T, float>) {
+      return float_value;
+    } else if constexpr (std::is_same_v<T, long double>) {
+      return long_double_value;
+    } else {
+      return value;
+    }
+  }
 };
 
 struct Variable {
@@ -24,7 +51,9 @@ struct Variable {
   Variable(std::string name);
 };
 
-// e.g., 2 + 3
+// e.g., 2 + 3. Comparisons are binary operators too and yield 1 or 0.
+// Operators spelled with two characters are stored as one; see
+// operatorSpelling.
 struct Binary {
   char op;
   ExprPtr left;
@@ -38,24 +67,89 @@ struct Unary {
   Unary(char op, ExprPtr operand);
 };
 
+// e.g., max(2, 3)
+struct Call {
+  const Function* function;
+  std::vector<ExprPtr> args;
+  Call(const Function* function, std::vector<ExprPtr> args);
+};
+
+// e.g., sum(i, 1, 10, i^2): body evaluated with the index bound to every
+// integer from..to in turn, combined with op ('+' or '*')
+struct Aggregate {
+  char op;
+  std::string index;
+  ExprPtr from;
+  ExprPtr to;
+  ExprPtr body;
+  Aggregate(char op, std::string index, ExprPtr from, ExprPtr to,
+            ExprPtr body);
+};
+
+// e.g., x > 0 && y > 0: op is '&' or '|', and right is only evaluated when
+// left doesn't decide the result. Yields 1 or 0.
+struct Logical {
+  char op;
+  ExprPtr left;
+  ExprPtr right;
+  Logical(char op, ExprPtr left, ExprPtr right);
+};
+
+// e.g., x < 0 ? -x : x: only the taken branch is evaluated
+struct Conditional {
+  ExprPtr condition;
+  ExprPtr then;
+  ExprPtr otherwise;
+  Conditional(ExprPtr condition, ExprPtr then, ExprPtr otherwise);
+};
+
 struct Expr {
-  std::variant<Number, Variable, Binary, Unary> node;
+  std::variant<Number, Variable, Binary, Unary, Call, Aggregate, Logical,
+               Conditional>
+      node;
+  // Only integer literals and arithmetic below, so the evaluator may use
+  // exact int64 arithmetic wherever a step's result is an int64
+  bool integral = false;
+  // Levels in this subtree, so the evaluator knows which ones it may walk by
+  // plain recursion
+  size_t height = 1;
 
   enum class Error {
     InvalidExpression,
     InvalidOperator,
     UnbalancedParentheses,
     UndefinedVariable,
-    DivisionByZero
+    DivisionByZero,
+    UnknownFunction,
+    ArityMismatch,
+    InvalidRange,
+    NestingTooDeep,
+    Cancelled
   };
 
+  ~Expr();
+
   static ExprPtr makeNumber(double value);
+  static ExprPtr makeNumber(Number number);
+  static ExprPtr makeInteger(std::int64_t value);
   static ExprPtr makeVariable(std::string name);
   static ExprPtr makeBinary(char op, ExprPtr left, ExprPtr right);
   static ExprPtr makeUnary(char op, ExprPtr operand);
+  static ExprPtr makeCall(const Function* function, std::vector<ExprPtr> args);
+  static ExprPtr makeAggregate(char op, std::string index, ExprPtr from,
+                               ExprPtr to, ExprPtr body);
+  static ExprPtr makeLogical(char op, ExprPtr left, ExprPtr right);
+  static ExprPtr makeConditional(ExprPtr condition, ExprPtr then,
+                                 ExprPtr otherwise);
 };
 
+// How the operator stored as op is written, e.g. "<=" for 'l'
+std::string_view operatorSpelling(char op);
+
 constexpr const std::string_view errorToString(Expr::Error error);
 std::ostream& operator<<(std::ostream& os, const Expr::Error error);
 
-std::expected<ExprPtr, Expr::Error> parseString(std::string_view infix);
+// When given, cancelled is polled every few thousand tokens and parsing
+// stops with Error::Cancelled once it is set.
+std::expected<ExprPtr, Expr::Error> parseString(
+    std::string_view infix, const std::atomic<bool>* cancelled = nullptr);
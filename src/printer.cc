@@ -9,6 +9,7 @@ std::string Printer::print(const Expr& expr) {
 }
 
 std::string Printer::visit(const Number& number) {
+  if (number.exact) return std::to_string(*number.exact);
   std::ostringstream oss;
   oss << number.value;
   return oss.str();
@@ -19,7 +20,8 @@ std::string Printer::visit(const Variable& variable) { return variable.name; }
 std::string Printer::visit(const Binary& binary) {
   std::string left = print(*binary.left);
   std::string right = print(*binary.right);
-  return "(" + left + " " + binary.op + " " + right + ")";
+  return "(" + left + " " + std::string(operatorSpelling(binary.op)) + " " +
+         right + ")";
 }
 
 std::string Printer::visit(const Unary& unary) {
@@ -28,3 +30,31 @@ std::string Printer::visit(const Unary& unary) {
 
   return "(" + op + operand + ")";
 }
+
+std::string Printer::visit(const Call& call) {
+  std::string result = std::string(call.function->name) + "(";
+  for (size_t i = 0; i < call.args.size(); ++i) {
+    if (i > 0) result += ", ";
+    result += print(*call.args[i]);
+  }
+  return result + ")";
+}
+
+std::string Printer::visit(const Aggregate& aggregate) {
+  std::string name = aggregate.op == '+' ? "sum" : "prod";
+  return name + "(" + aggregate.index + ", " + print(*aggregate.from) + ", " +
+         print(*aggregate.to) + ", " + print(*aggregate.body) + ")";
+}
+
+std::string Printer::visit(const Logical& logical) {
+  std::string left = print(*logical.left);
+  std::string right = print(*logical.right);
+  return "(" + left + " " + std::string(operatorSpelling(logical.op)) + " " +
+         right + ")";
+}
+
+std::string Printer::visit(const Conditional& conditional) {
+  return "(" + print(*conditional.condition) + " ? " +
+         print(*conditional.then) + " : " + print(*conditional.otherwise) +
+         ")";
+}
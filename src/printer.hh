@@ -10,6 +10,10 @@ class Printer {
   std::string visit(const Variable& variable);
   std::string visit(const Binary& binary);
   std::string visit(const Unary& binary);
+  std::string visit(const Call& call);
+  std::string visit(const Aggregate& aggregate);
+  std::string visit(const Logical& logical);
+  std::string visit(const Conditional& conditional);
 
  public:
   std::string print(const Expr& expr);
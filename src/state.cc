@@ -0,0 +1,115 @@
+#include "state.hh"
+
+#include <chrono>
+
+static std::string format(const Evaluator::Result& result) {
+  if (!result) return std::string(errorToString(result.error()));
+  if (auto integer = std::get_if<std::int64_t>(&*result)) {
+    return std::to_string(*integer);
+  }
+  std::string text = std::to_string(std::get<double>(*result));
+  text.erase(text.find_last_not_of('0') + 1, std::string::npos);
+  if (text.back() == '.') text.pop_back();
+  return text;
+}
+
+State::~State() { cancel(); }
+
+void State::insert(std::string_view text) {
+  cancel();
+  editor.insert(text);
+  show_result = false;
+}
+
+void State::erase() {
+  cancel();
+  editor.erase();
+  show_result = false;
+}
+
+void State::eraseForward() {
+  cancel();
+  editor.eraseForward();
+  show_result = false;
+}
+
+void State::clear() {
+  cancel();
+  editor.clear();
+  scroll = 0;
+  show_result = false;
+}
+
+void State::toggleSign() {
+  if (editor.empty()) return;
+  cancel();
+  std::size_t cursor = editor.cursor();
+  editor.moveTo(0);
+  if (editor[0] == '-') {
+    editor.eraseForward();
+    editor.moveTo(cursor > 0 ? cursor - 1 : 0);
+  } else {
+    editor.insert("-");
+    editor.moveTo(cursor + 1);
+  }
+  show_result = false;
+}
+
+void State::moveCursor(std::size_t position) {
+  editor.moveTo(position);
+  show_result = false;
+}
+
+void State::evaluate() {
+  cancel();
+
+  // The job gets its own copy of the text and a snapshot of the variables,
+  // so the UI can keep editing both.
+  auto snapshot =
+      std::make_shared<VariableStore::Snapshot>(variables.snapshot());
+  auto promise = std::make_shared<std::promise<std::string>>();
+  auto cancelled = std::make_shared<std::atomic<bool>>(false);
+  pending = promise->get_future();
+  pending_cancelled = cancelled;
+
+  worker.submit([expression = editor.text(), snapshot, compiled = compiled,
+                 promise, cancelled] {
+    if (!compiled->program || compiled->expression != expression) {
+      compiled->program.reset();
+      auto parseResult = parseString(expression, cancelled.get());
+      if (!parseResult) {
+        promise->set_value(std::string(errorToString(parseResult.error())));
+        return;
+      }
+      compiled->expr = std::move(*parseResult);
+      auto program =
+          std::make_unique<Incremental>(*compiled->expr, cancelled.get());
+      // A cancelled build may have folded Cancelled errors into constants.
+      if (cancelled->load()) {
+        promise->set_value(
+            std::string(errorToString(Expr::Error::Cancelled)));
+        return;
+      }
+      compiled->expression = expression;
+      compiled->program = std::move(program);
+    }
+    promise->set_value(
+        format(compiled->program->evaluate(**snapshot, cancelled.get())));
+  });
+}
+
+void State::poll() {
+  if (!pending.valid() ||
+      pending.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+    return;
+  }
+  display = pending.get();
+  show_result = true;
+  pending_cancelled.reset();
+}
+
+void State::cancel() {
+  if (pending_cancelled) pending_cancelled->store(true);
+  pending_cancelled.reset();
+  pending = {};
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <atomic>
+#include <future>
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include "editor.hh"
+#include "evaluator.hh"
+#include "incremental.hh"
+#include "parser.hh"
+#include "printer.hh"
+#include "variables.hh"
+#include "worker.hh"
+
+// Everything the calculator UI reads and edits. Kept apart from App so the
+// UI can be driven without a window (see bench/ui.cc).
+struct State {
+  Editor editor;           // The expression being typed
+  std::size_t scroll = 0;  // First character of the editor on screen
+  // The last result, shown instead of the expression until it is edited
+  std::string display = "0";
+  bool show_result = false;
+  bool show_var_table = false;
+  VariableStore variables;
+  Printer printer;
+
+  // The evaluation running on the worker, if any. Its result becomes the
+  // display once poll() sees it finished.
+  std::future<std::string> pending;
+  std::shared_ptr<std::atomic<bool>> pending_cancelled;
+
+  // The last expression the worker evaluated. Evaluating it again with
+  // different variables only recomputes what those variables affect. Only
+  // the worker thread touches it.
+  struct Compiled {
+    std::string expression;
+    ExprPtr expr;
+    std::unique_ptr<Incremental> program;
+  };
+  std::shared_ptr<Compiled> compiled = std::make_shared<Compiled>();
+
+  Worker worker;
+
+  ~State();
+
+  // Edits at the cursor. Each one cancels a running evaluation.
+  void insert(std::string_view text);
+  void erase();
+  void eraseForward();
+  void clear();
+  void toggleSign();  // Adds or removes a leading '-'
+  void moveCursor(std::size_t position);
+
+  void evaluate();
+  void poll();
+  void cancel();
+  bool computing() const { return pending.valid(); }
+};
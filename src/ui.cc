@@ -1,16 +1,81 @@
 #include "ui.hh"
 
+#include <imgui_stdlib.h>
+
+#include <algorithm>
+#include <cfloat>
+
 namespace ui {
-void renderDisplay(const App::State& state, ImFont* large_font) {
+// Lays out only the characters that fit, so a frame costs the same however
+// long the expression is. The view scrolls just enough to keep the cursor
+// visible.
+static void renderEditor(State& state, ImFont* font, float avail_width) {
+  const Editor& editor = state.editor;
+  std::size_t cursor = editor.cursor();
+  auto advance = [&](std::size_t i) {
+    return font->GetCharAdvance(
+        static_cast<ImWchar>(static_cast<unsigned char>(editor[i])));
+  };
+
+  std::size_t& first = state.scroll;
+  first = std::min(first, cursor);
+  std::size_t start = cursor;
+  float width = 0;
+  while (start > first && width + advance(start - 1) <= avail_width) {
+    width += advance(--start);
+  }
+  first = start;
+  float caret = width;
+
+  // Fill whatever room is left, first after the cursor, then before.
+  std::size_t end = cursor;
+  while (end < editor.size() && width + advance(end) <= avail_width) {
+    width += advance(end++);
+  }
+  while (first > 0 && width + advance(first - 1) <= avail_width) {
+    width += advance(--first);
+    caret += advance(first);
+  }
+
+  std::string visible;
+  for (std::size_t i = first; i < end; ++i) visible += editor[i];
+
+  ImGui::SetCursorPosX(std::max(0.0f, avail_width - width));
+  ImVec2 pos = ImGui::GetCursorScreenPos();
+  ImGui::TextUnformatted(visible.data(), visible.data() + visible.size());
+  ImGui::GetWindowDrawList()->AddLine(
+      ImVec2(pos.x + caret, pos.y),
+      ImVec2(pos.x + caret, pos.y + ImGui::GetTextLineHeight()),
+      ImGui::GetColorU32(ImGuiCol_Text));
+}
+
+void renderDisplay(State& state, ImFont* large_font, ImFont* small_font) {
   ImGui::PushStyleColor(ImGuiCol_FrameBg, ImVec4(0, 0, 0, 0));
   ImGui::PushStyleVar(ImGuiStyleVar_FramePadding, ImVec2(8, 16));
+  if (state.computing()) {
+    // Drawn over the spacer so the layout doesn't jump while evaluating
+    const char* label = "computing\u2026";
+    ImVec2 pos = ImGui::GetCursorScreenPos();
+    float label_width =
+        small_font->CalcTextSizeA(small_font->FontSize, FLT_MAX, 0.0f, label)
+            .x;
+    pos.x += ImGui::GetContentRegionAvail().x - 10 - label_width;
+    ImGui::GetWindowDrawList()->AddText(
+        small_font, small_font->FontSize, pos,
+        ImGui::GetColorU32(ImGuiCol_TextDisabled), label);
+  }
   ImGui::Dummy(ImVec2(0, 15));
   ImGui::PushFont(large_font);
-  float text_width = ImGui::CalcTextSize(state.display.c_str()).x;
   float avail_width = ImGui::GetContentRegionAvail().x - 10;
-  ImGui::SetCursorPosX(std::max(0.0f, avail_width - text_width));
   ImGui::PushStyleColor(ImGuiCol_Text, ImVec4(1.0f, 1.0f, 1.0f, 1.0f));
-  ImGui::Text("%s", state.display.c_str());
+  if (state.show_result || state.editor.empty()) {
+    const char* text = state.show_result ? state.display.c_str() : "0";
+    float text_width = ImGui::CalcTextSize(text).x;
+    ImGui::SetCursorPosX(std::max(0.0f, avail_width - text_width));
+    ImGui::Text("%s", text);
+  } else {
+    renderEditor(state, large_font, avail_width);
+  }
   ImGui::PopStyleColor();
   ImGui::PopFont();
   ImGui::PopStyleVar();
@@ -33,7 +98,7 @@ void button(const char* label, const ImVec4& color, ImFont* button_font,
   ImGui::PopFont();
 }
 
-void calculator(App::State& state, int window_width, int window_height,
+void calculator(State& state, int window_width, int window_height,
                 ImFont* large_font, ImFont* button_font) {
   const ImVec4 number_color(0.2f, 0.2f, 0.2f, 1.0f);
   const ImVec4 operation_color(0.8f, 0.4f, 0.0f, 1.0f);
@@ -49,7 +114,7 @@ void calculator(App::State& state, int window_width, int window_height,
                ImGuiWindowFlags_NoTitleBar | ImGuiWindowFlags_NoResize |
                    ImGuiWindowFlags_NoMove | ImGuiWindowFlags_NoScrollbar);
 
-  renderDisplay(state, large_font);
+  renderDisplay(state, large_font, button_font);
 
   ImGui::PushStyleVar(ImGuiStyleVar_ItemSpacing, ImVec2(4.0f, 4.0f));
   ImGui::Dummy(ImVec2(0, 10));
@@ -57,25 +122,20 @@ void calculator(App::State& state, int window_width, int window_height,
 
   auto numberButton = [&](const char* label) {
     button(label, number_color, button_font, button_width, button_height,
-           [&]() { state.updateExpression(state.expression + label); });
+           [&]() { state.insert(label); });
   };
 
   auto operationButton = [&](const char* label, char op) {
     button(label, operation_color, button_font, button_width, button_height,
-           [&]() { state.updateExpression(state.expression + op); });
+           [&]() { state.insert(std::string_view(&op, 1)); });
   };
 
   button("C", clear_color, button_font, button_width, button_height,
-         [&]() { state.updateExpression(""); });
-  button("+/-", clear_color, button_font, button_width, button_height, [&]() {
-    if (!state.expression.empty() && state.expression[0] != '-') {
-      state.updateExpression("-" + state.expression);
-    } else if (!state.expression.empty()) {
-      state.updateExpression(state.expression.substr(1));
-    }
-  });
+         [&]() { state.clear(); });
+  button("+/-", clear_color, button_font, button_width, button_height,
+         [&]() { state.toggleSign(); });
   button("%", clear_color, button_font, button_width, button_height,
-         [&]() { state.updateExpression(state.expression + "%"); });
+         [&]() { state.insert("%"); });
   operationButton("÷", '/');
   ImGui::NewLine();
 
@@ -101,14 +161,14 @@ void calculator(App::State& state, int window_width, int window_height,
          [&]() { state.show_var_table = true; });
   numberButton("0");
   button(".", number_color, button_font, button_width, button_height,
-         [&]() { state.updateExpression(state.expression + "."); });
+         [&]() { state.insert("."); });
   button("=", operation_color, button_font, button_width, button_height,
          [&]() { state.evaluate(); });
   ImGui::PopStyleVar();
   ImGui::End();
 }
 
-void variableTable(App::State& state, int window_width, int window_height,
+void variableTable(State& state, int window_width, int window_height,
                    ImFont* large_font, ImFont* button_font) {
   const ImVec4 back_color(0.1f, 0.4f, 0.7f, 1.0f);
   const ImVec4 add_color(0.2f, 0.6f, 0.2f, 1.0f);
@@ -142,7 +202,7 @@ void variableTable(App::State& state, int window_width, int window_height,
   ImGui::SameLine();
   button("Add", add_color, button_font, 45, 0, [&]() {
     if (!var_name.empty()) {
-      state.evaluator.setVariable(var_name, var_value);
+      state.variables.set(var_name, var_value);
     }
   });
   ImGui::PopFont();
@@ -155,8 +215,10 @@ void variableTable(App::State& state, int window_width, int window_height,
   ImGui::SetColumnWidth(1, 50);
   ImGui::PushFont(button_font);
 
-  auto vars = state.evaluator.variables;
-  for (auto& [name, value] : vars) {
+  // Edits below publish new versions; this frame keeps listing the one
+  // it started with.
+  auto vars = state.variables.snapshot();
+  for (const auto& [name, value] : *vars) {
     ImGui::Text("%s", name.c_str());
     ImGui::NextColumn();
 
@@ -164,17 +226,17 @@ void variableTable(App::State& state, int window_width, int window_height,
     std::string id = "##val" + name;
     ImGui::SetNextItemWidth(85);
     if (ImGui::InputDouble(id.c_str(), &temp_value)) {
-      state.evaluator.setVariable(name, temp_value);
+      state.variables.set(name, temp_value);
     }
     ImGui::NextColumn();
 
     button("Use", use_color, button_font, 40, 0, [&]() {
-      state.updateExpression(state.expression + name);
+      state.insert(name);
       state.show_var_table = false;
     });
     ImGui::SameLine(0, 2);
     button("X", delete_color, button_font, 20, 0,
-           [&]() { state.evaluator.variables.erase(name); });
+           [&]() { state.variables.erase(name); });
     ImGui::NextColumn();
   }
 
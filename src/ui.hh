@@ -4,16 +4,18 @@
 
 #include <functional>
 
-#include "app.hh"
+#include "state.hh"
+
+class App;
 
 namespace ui {
 void renderUI(App& app);
-void renderDisplay(const App::State& state, ImFont* large_font);
+void renderDisplay(State& state, ImFont* large_font, ImFont* small_font);
 void button(const char* label, const ImVec4& color, ImFont* button_font,
             float width, float height, std::function<void()> action);
-void calculator(App::State& state, int window_width, int window_height,
+void calculator(State& state, int window_width, int window_height,
                 ImFont* large_font, ImFont* button_font);
-void variableTable(App::State& state, int window_width, int window_height,
+void variableTable(State& state, int window_width, int window_height,
                    ImFont* large_font, ImFont* button_font);
 }
 
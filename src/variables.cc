@@ -0,0 +1,78 @@
+#include "variables.hh"
+
+#include <memory>
+#include <thread>
+#include <utility>
+
+VariableStore::Snapshot::Snapshot(Snapshot&& other) noexcept
+    : slot(std::exchange(other.slot, nullptr)), map(other.map) {}
+
+VariableStore::Snapshot::~Snapshot() {
+  if (slot) slot->store(nullptr, std::memory_order_release);
+}
+
+VariableStore::VariableStore() : current(new Map()) {}
+
+VariableStore::~VariableStore() {
+  delete current.load();
+  for (const Map* map : retired) delete map;
+}
+
+VariableStore::Snapshot VariableStore::snapshot() const {
+  // Readers start where they last found a free slot, so they rarely
+  // contend for the same one.
+  static thread_local std::size_t hint = 0;
+  const Map* map = current.load();
+
+  for (std::size_t tried = 0;; ++tried) {
+    std::size_t i = (hint + tried) % kSlots;
+    const Map* free = nullptr;
+    if (!slots[i].compare_exchange_strong(free, map)) {
+      if (tried % kSlots == kSlots - 1) std::this_thread::yield();
+      continue;
+    }
+    hint = i;
+
+    // The map may have been replaced, and even freed, before the
+    // announcement landed. Once it is still current afterwards, no writer
+    // can free it until the slot is cleared.
+    for (const Map* latest; (latest = current.load()) != map;) {
+      map = latest;
+      slots[i].store(map);
+    }
+    return Snapshot(&slots[i], map);
+  }
+}
+
+void VariableStore::set(const std::string& name, double value) {
+  publish([&](Map& map) { map[name] = value; });
+}
+
+void VariableStore::erase(const std::string& name) {
+  publish([&](Map& map) { map.erase(name); });
+}
+
+void VariableStore::clear() {
+  publish([](Map& map) { map.clear(); });
+}
+
+void VariableStore::assign(Map variables) {
+  publish([&](Map& map) { map = std::move(variables); });
+}
+
+template <typename Edit>
+void VariableStore::publish(Edit edit) {
+  std::lock_guard lock(writer);
+  // Only writers free maps, so the current one can be read safely here.
+  auto next = std::make_unique<Map>(*current.load());
+  edit(*next);
+  retired.push_back(current.exchange(next.release()));
+
+  std::erase_if(retired, [this](const Map* map) {
+    for (const auto& slot : slots) {
+      if (slot.load() == map) return false;
+    }
+    delete map;
+    return true;
+  });
+}
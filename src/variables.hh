@@ -0,0 +1,71 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Variables shared between the UI, which edits them, and any number of
+// evaluation threads, which read them. Every edit publishes a new immutable
+// map; a reader takes a Snapshot of whichever map is current and keeps a
+// consistent view of it however the variables change afterwards. Readers
+// never lock and never wait for writers.
+//
+// Replaced maps are freed with hazard pointers: a snapshot announces the map
+// it reads in one of a fixed set of slots, and a writer only frees the maps
+// no slot announces.
+class VariableStore {
+ public:
+  using Map = std::map<std::string, double>;
+
+  class Snapshot {
+   public:
+    Snapshot(Snapshot&& other) noexcept;
+    Snapshot& operator=(Snapshot&&) = delete;
+    ~Snapshot();
+
+    const Map& operator*() const { return *map; }
+    const Map* operator->() const { return map; }
+
+   private:
+    friend class VariableStore;
+    Snapshot(std::atomic<const Map*>* slot, const Map* map)
+        : slot(slot), map(map) {}
+
+    std::atomic<const Map*>* slot;  // nullptr once moved from
+    const Map* map;
+  };
+
+  VariableStore();
+  // Every snapshot must have been released by then.
+  ~VariableStore();
+
+  VariableStore(const VariableStore&) = delete;
+  VariableStore& operator=(const VariableStore&) = delete;
+
+  // Never waits for writers; it only spins while more than kSlots snapshots
+  // are alive at once.
+  Snapshot snapshot() const;
+
+  // Each edit copies the current map. Concurrent writers take turns.
+  void set(const std::string& name, double value);
+  void erase(const std::string& name);
+  void clear();
+  void assign(Map variables);  // Replaces them all in one edit
+
+ private:
+  static constexpr std::size_t kSlots = 128;
+
+  std::atomic<const Map*> current;
+  // The map each live snapshot reads, nullptr for free slots
+  mutable std::array<std::atomic<const Map*>, kSlots> slots{};
+
+  std::mutex writer;
+  std::vector<const Map*> retired;  // Replaced, but maybe still read
+
+  template <typename Edit>
+  void publish(Edit edit);
+};
@@ -0,0 +1,203 @@
+#include "vmath.hh"
+
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+
+namespace {
+constexpr double kInf = std::numeric_limits<double>::infinity();
+constexpr double kNaN = std::numeric_limits<double>::quiet_NaN();
+
+// Adding this constant rounds to the nearest integer and leaves that integer
+// in the low mantissa bits, which avoids a (non-vectorizable) lround.
+constexpr double kRoundMagic = 0x1.8p52;
+
+// ln(2) split so that k * kLn2Hi is exact for |k| < 2^11.
+constexpr double kLn2Hi = 6.93147180369123816490e-01;
+constexpr double kLn2Lo = 1.90821492927058770002e-10;
+
+// pi/2 split into 33-bit pieces so that k * piece is exact for |k| < 2^20.
+constexpr double kPio2_1 = 1.57079632673412561417e+00;
+constexpr double kPio2_2 = 6.07710050630396597660e-11;
+constexpr double kPio2_3 = 2.02226624871116645580e-21;
+constexpr double kTrigLimit = 0x1p20 * 1.57079632679489661923;
+
+inline std::int64_t roundedBits(double x) {
+  return std::bit_cast<std::int64_t>(x + kRoundMagic) -
+         std::bit_cast<std::int64_t>(kRoundMagic);
+}
+
+inline double pow2(std::int64_t k) {
+  return std::bit_cast<double>(static_cast<std::uint64_t>(k + 1023) << 52);
+}
+
+inline double expKernel(double x) {
+  double clamped = x < -746.0 ? -746.0 : (x > 710.0 ? 710.0 : x);
+  double kd = (clamped * 1.4426950408889634 + kRoundMagic) - kRoundMagic;
+  std::int64_t k = roundedBits(clamped * 1.4426950408889634);
+  double r = (clamped - kd * kLn2Hi) - kd * kLn2Lo;
+
+  // Taylor series to r^13; |r| <= ln(2)/2 keeps the truncation below 2^-58.
+  double p = 1.0 / 6227020800.0;
+  p = p * r + 1.0 / 479001600.0;
+  p = p * r + 1.0 / 39916800.0;
+  p = p * r + 1.0 / 3628800.0;
+  p = p * r + 1.0 / 362880.0;
+  p = p * r + 1.0 / 40320.0;
+  p = p * r + 1.0 / 5040.0;
+  p = p * r + 1.0 / 720.0;
+  p = p * r + 1.0 / 120.0;
+  p = p * r + 1.0 / 24.0;
+  p = p * r + 1.0 / 6.0;
+  p = p * r + 0.5;
+  p = p * r * r + r;
+  p = 1.0 + p;
+
+  // Scale in two steps so that k = 1024 and gradual underflow both work.
+  std::int64_t k1 = k >> 1;
+  double result = p * pow2(k1) * pow2(k - k1);
+
+  result = x > 709.782712893384 ? kInf : result;
+  result = x < -745.1332191019412 ? 0.0 : result;
+  return x != x ? x : result;
+}
+
+inline double logKernel(double x) {
+  // Bring subnormals into the normal range first.
+  bool subnormal = x < 0x1p-1022;
+  double scaled = subnormal ? x * 0x1p54 : x;
+  std::uint64_t bits = std::bit_cast<std::uint64_t>(scaled);
+
+  // The exponent field as a double, by the kRoundMagic trick in reverse:
+  // int64 to double conversion needs AVX-512 on x86.
+  double dk = std::bit_cast<double>(((bits >> 52) & 0x7ff) |
+                                    std::bit_cast<std::uint64_t>(0x1p52)) -
+              (0x1p52 + 1023);
+  dk -= subnormal ? 54.0 : 0.0;
+  double m = std::bit_cast<double>((bits & 0x000fffffffffffffULL) |
+                                   0x3ff0000000000000ULL);
+  bool high = m > 1.4142135623730951;
+  m = high ? m * 0.5 : m;
+  dk += high ? 1.0 : 0.0;
+
+  double f = m - 1.0;
+  double s = f / (2.0 + f);
+  double z = s * s;
+  double w = z * z;
+  double t1 =
+      w * (3.999999999940941908e-01 +
+           w * (2.222219843214978396e-01 + w * 1.531383769920937332e-01));
+  double t2 =
+      z * (6.666666666666735130e-01 +
+           w * (2.857142874366239149e-01 +
+                w * (1.818357216161805012e-01 + w * 1.479819860511658591e-01)));
+  double hfsq = 0.5 * f * f;
+  double result =
+      dk * kLn2Hi - ((hfsq - (s * (hfsq + t1 + t2) + dk * kLn2Lo)) - f);
+
+  result = x == kInf ? kInf : result;
+  result = x == 0.0 ? -kInf : result;
+  result = x < 0.0 ? kNaN : result;
+  return x != x ? x : result;
+}
+
+// Polynomials on [-pi/4, pi/4]; y is the tail of the reduced argument.
+inline double sinPoly(double x, double y) {
+  double z = x * x;
+  double v = z * x;
+  double r = 8.33333333332248946124e-03 +
+             z * (-1.98412698298579493134e-04 +
+                  z * (2.75573137070700676789e-06 +
+                       z * (-2.50507602534068634195e-08 +
+                            z * 1.58969099521155010221e-10)));
+  return x - ((z * (0.5 * y - v * r) - y) - v * -1.66666666666666324348e-01);
+}
+
+inline double cosPoly(double x, double y) {
+  double z = x * x;
+  double r = z * (4.16666666666666019037e-02 +
+                  z * (-1.38888888888741095749e-03 +
+                       z * (2.48015872894767294178e-05 +
+                            z * (-2.75573143513906633035e-07 +
+                                 z * (2.08757232129817482790e-09 +
+                                      z * -1.13596475577881948265e-11)))));
+  double hz = 0.5 * z;
+  double w = 1.0 - hz;
+  return w + (((1.0 - w) - hz) + (z * r - x * y));
+}
+
+// Reduces x to r + y with r in [-pi/4, pi/4], returning the quadrant in q.
+inline double reduce(double x, double& y, std::int64_t& q) {
+  double clamped = std::fabs(x) > kTrigLimit ? 0.0 : x;
+  double t = clamped * 0.63661977236758134308;
+  double kd = (t + kRoundMagic) - kRoundMagic;
+  q = roundedBits(t);
+
+  // Both products are exact; the subtraction error is recovered in y.
+  double a = clamped - kd * kPio2_1;
+  double b = kd * kPio2_2;
+  double r = a - b;
+  y = ((a - r) - b) - kd * kPio2_3;
+  double sum = r + y;
+  y -= sum - r;
+  return sum;
+}
+
+// The sine q quarter turns on from an angle whose sine and cosine are s and
+// c. Masks rather than selects: SSE2 can't pick doubles by an int64 test.
+inline double turn(double s, double c, std::int64_t q) {
+  auto odd = static_cast<std::uint64_t>(-(q & 1));
+  std::uint64_t bits = (std::bit_cast<std::uint64_t>(c) & odd) |
+                       (std::bit_cast<std::uint64_t>(s) & ~odd);
+  return std::bit_cast<double>(bits ^ static_cast<std::uint64_t>(q & 2) << 62);
+}
+
+inline double sinKernel(double x) {
+  std::int64_t q;
+  double y;
+  double r = reduce(x, y, q);
+  return turn(sinPoly(r, y), cosPoly(r, y), q);
+}
+
+inline double cosKernel(double x) {
+  std::int64_t q;
+  double y;
+  double r = reduce(x, y, q);
+  return turn(sinPoly(r, y), cosPoly(r, y), q + 1);
+}
+
+// Lanes the vector reduction can't handle (huge, infinite or NaN) go
+// through libm instead.
+template <typename F>
+void patchOutOfRange(std::span<const double> in, std::span<double> out,
+                     F scalar) {
+  for (size_t i = 0; i < in.size(); ++i) {
+    if (!(std::fabs(in[i]) <= kTrigLimit)) out[i] = scalar(in[i]);
+  }
+}
+}  // namespace
+
+namespace vmath {
+void exp(std::span<const double> in, std::span<double> out) {
+  for (size_t i = 0; i < in.size(); ++i) out[i] = expKernel(in[i]);
+}
+
+void log(std::span<const double> in, std::span<double> out) {
+  for (size_t i = 0; i < in.size(); ++i) out[i] = logKernel(in[i]);
+}
+
+void sin(std::span<const double> in, std::span<double> out) {
+  for (size_t i = 0; i < in.size(); ++i) out[i] = sinKernel(in[i]);
+  patchOutOfRange(in, out, [](double x) { return std::sin(x); });
+}
+
+void cos(std::span<const double> in, std::span<double> out) {
+  for (size_t i = 0; i < in.size(); ++i) out[i] = cosKernel(in[i]);
+  patchOutOfRange(in, out, [](double x) { return std::cos(x); });
+}
+
+void sqrt(std::span<const double> in, std::span<double> out) {
+  for (size_t i = 0; i < in.size(); ++i) out[i] = std::sqrt(in[i]);
+}
+}  // namespace vmath
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <span>
+
+// Batch math kernels, written so that their loops vectorize for plain
+// x86-64: branch-free, with special inputs handled by selects, and with no
+// int64 to double conversion or choice of doubles by an int64 test, which
+// SSE2 has no instructions for. sqrt also needs -fno-math-errno. Errors are
+// measured against a long double reference over the documented ranges by
+// bench/check.cc.
+namespace vmath {
+// Max error 1 ULP. Exact 0 below -745.13, +inf above 709.78.
+void exp(std::span<const double> in, std::span<double> out);
+
+// Max error 1 ULP. NaN for negative inputs, -inf at zero.
+void log(std::span<const double> in, std::span<double> out);
+
+// Max error 1 ULP for |x| <= 2^20 * pi/2. Larger inputs are patched with
+// std::sin/std::cos in a second, scalar pass.
+void sin(std::span<const double> in, std::span<double> out);
+void cos(std::span<const double> in, std::span<double> out);
+
+// Correctly rounded (hardware square root).
+void sqrt(std::span<const double> in, std::span<double> out);
+}  // namespace vmath
@@ -0,0 +1,98 @@
+#include "worker.hh"
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Evaluation recurses only through short subtrees and sums nested in sums,
+// both bounded, and keeps deeper stacks on the heap. That still calls for
+// more than the small default stack of secondary threads (512 KiB on macOS).
+static constexpr size_t kStackSize = 8 * 1024 * 1024;
+
+static bool spawn(pthread_t& thread, void* (*entry)(void*), void* arg) {
+  pthread_attr_t attr;
+  pthread_attr_init(&attr);
+  pthread_attr_setstacksize(&attr, kStackSize);
+  bool spawned = pthread_create(&thread, &attr, entry, arg) == 0;
+  pthread_attr_destroy(&attr);
+  return spawned;
+}
+
+Worker::Worker() {
+  started = spawn(
+      thread,
+      [](void* self) -> void* {
+        static_cast<Worker*>(self)->run();
+        return nullptr;
+      },
+      this);
+}
+
+Worker::~Worker() {
+  if (!started) return;
+  {
+    std::lock_guard lock(mutex);
+    stopping = true;
+  }
+  ready.notify_one();
+  pthread_join(thread, nullptr);
+}
+
+void Worker::submit(std::function<void()> job) {
+  if (!started) {
+    job();
+    return;
+  }
+  {
+    std::lock_guard lock(mutex);
+    next = std::move(job);
+  }
+  ready.notify_one();
+}
+
+void Worker::run() {
+  while (true) {
+    std::function<void()> job;
+    bool stop;
+    {
+      std::unique_lock lock(mutex);
+      ready.wait(lock, [this] { return stopping || next; });
+      job = std::exchange(next, nullptr);
+      stop = stopping;
+    }
+    // A job queued at shutdown is dropped here, unrun.
+    if (stop) return;
+    job();
+  }
+}
+
+void parallelFor(std::size_t count,
+                 const std::function<void(std::size_t)>& task,
+                 std::size_t threads) {
+  std::atomic<std::size_t> next = 0;
+  std::function<void()> drain = [&] {
+    for (std::size_t i; (i = next.fetch_add(1)) < count;) task(i);
+  };
+
+  if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+  std::vector<pthread_t> helpers;
+  for (std::size_t i = 1; i < std::min(threads, count); ++i) {
+    pthread_t helper;
+    // Too few threads only makes it slower; the caller drains the rest.
+    if (!spawn(
+            helper,
+            [](void* drain) -> void* {
+              (*static_cast<std::function<void()>*>(drain))();
+              return nullptr;
+            },
+            &drain)) {
+      break;
+    }
+    helpers.push_back(helper);
+  }
+
+  drain();
+  for (pthread_t helper : helpers) pthread_join(helper, nullptr);
+}
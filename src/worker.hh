@@ -0,0 +1,42 @@
+#pragma once
+
+#include <pthread.h>
+
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+
+// Runs jobs one at a time on a background thread. A job submitted while
+// another is still queued replaces it; jobs that are already running are
+// expected to notice cancellation themselves. A job still queued when the
+// worker is destroyed never runs, but is released on the worker thread.
+// Should the thread fail to start, submit runs each job itself instead, on
+// the caller's thread.
+class Worker {
+ public:
+  Worker();
+  ~Worker();
+
+  Worker(const Worker&) = delete;
+  Worker& operator=(const Worker&) = delete;
+
+  void submit(std::function<void()> job);
+
+ private:
+  std::mutex mutex;
+  std::condition_variable ready;
+  std::function<void()> next;
+  bool stopping = false;
+  bool started = false;  // Whether thread holds a running thread
+  pthread_t thread;
+
+  void run();
+};
+
+// Calls task(0) .. task(count - 1) on up to threads threads, or as many as
+// there are cores when 0, the calling thread included, and returns once all
+// calls have finished. Indices are handed out in increasing order.
+void parallelFor(std::size_t count,
+                 const std::function<void(std::size_t)>& task,
+                 std::size_t threads = 0);
@@ -0,0 +1,121 @@
+// Build-time font baker: rasterizes a TTF at the sizes the app uses and
+// writes the atlas and glyph tables as C++ for src/font.cc to embed.
+//
+//   bake_font <font.ttf> <output.inc>
+
+#include <imgui.h>
+
+#include <cstdio>
+#include <vector>
+
+#include "../src/font.hh"
+
+static constexpr float kSizes[] = {28.0f, 18.0f};  // Display, buttons
+
+// Latin-1 covers the labels (including × and ÷) and every expression
+// character; the ellipsis is used by the display.
+static constexpr ImWchar kRanges[] = {0x0020, 0x00FF, 0x2026, 0x2026, 0};
+
+// See unpackBits in src/font.cc for the format.
+static std::vector<unsigned char> packBits(const unsigned char* in,
+                                           size_t size) {
+  std::vector<unsigned char> out;
+  size_t i = 0;
+  while (i < size) {
+    size_t run = 1;
+    while (i + run < size && run < 130 && in[i + run] == in[i]) run++;
+    if (run >= 3) {
+      out.push_back(static_cast<unsigned char>(run + 125));
+      out.push_back(in[i]);
+      i += run;
+      continue;
+    }
+    // Collect literals until the next run worth encoding.
+    size_t start = i;
+    while (i < size && i - start < 128) {
+      if (i + 2 < size && in[i] == in[i + 1] && in[i] == in[i + 2]) break;
+      i++;
+    }
+    out.push_back(static_cast<unsigned char>(i - start - 1));
+    out.insert(out.end(), in + start, in + i);
+  }
+  return out;
+}
+
+int main(int argc, char** argv) {
+  if (argc != 3) {
+    std::fprintf(stderr, "usage: %s <font.ttf> <output.inc>\n", argv[0]);
+    return 1;
+  }
+
+  ImFontAtlas atlas;
+  atlas.Flags |=
+      ImFontAtlasFlags_NoBakedLines | ImFontAtlasFlags_NoMouseCursors;
+  std::vector<ImFont*> fonts;
+  for (float size : kSizes) {
+    ImFontConfig font_config;
+    font_config.OversampleH = 2;
+    font_config.OversampleV = 2;
+    font_config.SizePixels = size;
+    ImFont* font =
+        atlas.AddFontFromFileTTF(argv[1], size, &font_config, kRanges);
+    if (!font) {
+      std::fprintf(stderr, "failed to load %s\n", argv[1]);
+      return 1;
+    }
+    fonts.push_back(font);
+  }
+
+  unsigned char* pixels;
+  int width, height;
+  atlas.GetTexDataAsAlpha8(&pixels, &width, &height);
+  size_t pixel_count = static_cast<size_t>(width) * static_cast<size_t>(height);
+  std::vector<unsigned char> packed = packBits(pixels, pixel_count);
+
+  FILE* out = std::fopen(argv[2], "w");
+  if (!out) {
+    std::fprintf(stderr, "failed to open %s\n", argv[2]);
+    return 1;
+  }
+
+  std::fprintf(out, "// Generated by tools/bake_font.cc from %s\n", argv[1]);
+  std::fprintf(out, "#pragma once\n\nnamespace baked {\n");
+  std::fprintf(out, "constexpr int kAtlasWidth = %d;\n", width);
+  std::fprintf(out, "constexpr int kAtlasHeight = %d;\n", height);
+  std::fprintf(out, "constexpr float kWhiteU = %af;\n",
+               atlas.TexUvWhitePixel.x);
+  std::fprintf(out, "constexpr float kWhiteV = %af;\n\n",
+               atlas.TexUvWhitePixel.y);
+
+  std::fprintf(out, "constexpr unsigned char kAtlasPixels[] = {");
+  for (size_t i = 0; i < packed.size(); ++i) {
+    std::fprintf(out, "%s%u,", i % 20 == 0 ? "\n   " : "", packed[i]);
+  }
+  std::fprintf(out, "\n};\n\n");
+
+  for (size_t f = 0; f < fonts.size(); ++f) {
+    std::fprintf(out, "constexpr BakedGlyph kGlyphs%zu[] = {\n", f);
+    for (const ImFontGlyph& g : fonts[f]->Glyphs) {
+      std::fprintf(out,
+                   "    {%u, %af, %af, %af, %af, %af, %af, %af, "
+                   "%af, %af},\n",
+                   static_cast<unsigned>(g.Codepoint), g.AdvanceX, g.X0, g.Y0,
+                   g.X1, g.Y1, g.U0, g.V0, g.U1, g.V1);
+    }
+    std::fprintf(out, "};\n\n");
+  }
+
+  std::fprintf(out, "constexpr BakedFont kFonts[] = {\n");
+  for (size_t f = 0; f < fonts.size(); ++f) {
+    std::fprintf(out,
+                 "    {%af, %af, %af, kGlyphs%zu, std::size(kGlyphs%zu)},\n",
+                 fonts[f]->FontSize, fonts[f]->Ascent, fonts[f]->Descent, f,
+                 f);
+  }
+  std::fprintf(out, "};\n}  // namespace baked\n");
+
+  std::fclose(out);
+  std::printf("baked %dx%d atlas into %zu bytes\n", width, height,
+              packed.size());
+  return 0;
+}